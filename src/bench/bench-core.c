@@ -0,0 +1,200 @@
+/**
+ * @file
+ * Benchmarks for libcore: formatting, string, path, and memory functions
+ */
+#include "bench.h"
+
+#include <core/path.h>
+#include <core/sprintf.h>
+#include <core/string.h>
+
+#include <stddef.h>
+
+#define BENCH "bench-core"
+
+static char fmtbuf[256];
+
+/** @name snprintf */
+///@{
+
+static void snprintf_dec(void *arg)
+{
+    BENCH_KEEP(snprintf(fmtbuf, sizeof(fmtbuf), "%d", *(int *) arg));
+}
+
+static void snprintf_hex(void *arg)
+{
+    BENCH_KEEP(snprintf(fmtbuf, sizeof(fmtbuf), "%#lx", *(long *) arg));
+}
+
+static void snprintf_ptr(void *arg)
+{
+    BENCH_KEEP(snprintf(fmtbuf, sizeof(fmtbuf), "%p", arg));
+}
+
+static void snprintf_str(void *arg)
+{
+    BENCH_KEEP(snprintf(fmtbuf, sizeof(fmtbuf), "%s", (char *) arg));
+}
+
+/** A typical log line: level, prefix, and a few numbers */
+static void snprintf_logline(void *arg)
+{
+    BENCH_KEEP(snprintf(
+            fmtbuf, sizeof(fmtbuf), "%-7s: %s: seg %zu: offset=%#lx size=%u\n",
+            "info", "elf.c", (size_t) 3, *(long *) arg, 4096u
+    ));
+}
+
+///@}
+
+/** @name String searches */
+///@{
+
+struct strstr_args {
+    const char *haystack, *needle;
+};
+
+static void strstr_case(void *arg)
+{
+    struct strstr_args *a = arg;
+    BENCH_KEEP(strstr(a->haystack, a->needle));
+}
+
+///@}
+
+/** @name Paths */
+///@{
+
+static void path_join_case(void *arg)
+{
+    BENCH_KEEP(path_join(fmtbuf, sizeof(fmtbuf), "/usr/local", arg));
+}
+
+static void path_basename_case(void *arg)
+{
+    BENCH_KEEP(path_basename(fmtbuf, sizeof(fmtbuf), arg));
+}
+
+///@}
+
+/** @name Memory functions, compared against plain byte loops */
+///@{
+
+struct mem_args {
+    unsigned char *dst, *src;
+    size_t         n;
+};
+
+static void memcpy_case(void *arg)
+{
+    struct mem_args *a = arg;
+    BENCH_KEEP(memcpy(a->dst, a->src, a->n));
+}
+
+static void memset_case(void *arg)
+{
+    struct mem_args *a = arg;
+    BENCH_KEEP(memset(a->dst, 0x5a, a->n));
+}
+
+static void memmove_case(void *arg)
+{
+    struct mem_args *a = arg;
+    BENCH_KEEP(memmove(a->dst, a->src, a->n));
+}
+
+static void memcmp_case(void *arg)
+{
+    struct mem_args *a = arg;
+    BENCH_KEEP(memcmp(a->dst, a->src, a->n));
+}
+
+static void memcpy_bytes_case(void *arg)
+{
+    struct mem_args *a = arg;
+    for (size_t i = 0; i < a->n; i++) {
+        a->dst[i] = a->src[i];
+        BENCH_KEEP(a->dst);
+    }
+}
+
+static void memset_bytes_case(void *arg)
+{
+    struct mem_args *a = arg;
+    for (size_t i = 0; i < a->n; i++) {
+        a->dst[i] = 0x5a;
+        BENCH_KEEP(a->dst);
+    }
+}
+
+static void memcmp_bytes_case(void *arg)
+{
+    struct mem_args *a = arg;
+    int              d = 0;
+    for (size_t i = 0; i < a->n && !d; i++) {
+        d = a->dst[i] - a->src[i];
+        BENCH_KEEP(d);
+    }
+}
+
+///@}
+
+int main(void)
+{
+    /* snprintf */
+    int  ival = -123456;
+    long lval = 0x12ab34cdL;
+    bench_run(BENCH, "snprintf/%d", 0, snprintf_dec, &ival);
+    bench_run(BENCH, "snprintf/%#lx", 0, snprintf_hex, &lval);
+    bench_run(BENCH, "snprintf/%p", 0, snprintf_ptr, &lval);
+    bench_run(BENCH, "snprintf/%s", 0, snprintf_str, "hello-raw");
+    bench_run(BENCH, "snprintf/logline", 0, snprintf_logline, &lval);
+
+    /* strstr: a short path prefix, and a periodic worst case for naive
+     * search: "aaa...a" searched for "aaa...ab". */
+    struct strstr_args path = {"/bin/hello-raw", "/bin"};
+    bench_run(BENCH, "strstr/path", 0, strstr_case, &path);
+
+    for (size_t hlen = 256; hlen <= 16384; hlen *= 8) {
+        char *h = bench_malloc(hlen + 1), n[33];
+        memset(h, 'a', hlen), h[hlen] = '\0';
+        memset(n, 'a', 31), n[31] = 'b', n[32] = '\0';
+        struct strstr_args periodic = {h, n};
+        bench_run(BENCH, "strstr/periodic", hlen, strstr_case, &periodic);
+        bench_free(h);
+    }
+
+    /* Paths */
+    bench_run(BENCH, "path_join", 0, path_join_case, "bin/hello-raw");
+    bench_run(BENCH, "path_basename", 0, path_basename_case, "/bin/hello-raw");
+
+    /* Memory functions, 1 B to 1 MiB. Offset the source by one byte
+     * to include the cost of the unaligned case. memmove shifts a buffer
+     * by one byte in place, both ways, and memcmp compares equal buffers,
+     * so it has to read all of them.
+     *
+     * N.B. The host is x86_64, so this never runs the i386 `rep` path. */
+    const size_t   maxsz = 1 << 20;
+    unsigned char *dst   = bench_malloc(maxsz + 1);
+    unsigned char *src   = bench_malloc(maxsz + 1);
+    unsigned char *ones  = bench_malloc(maxsz);
+    memset(src, 1, maxsz + 1);
+    memset(ones, 1, maxsz);
+    for (size_t n = 1; n <= maxsz; n *= 4) {
+        struct mem_args a   = {dst, src + 1, n};
+        struct mem_args fwd = {dst, dst + 1, n}, bwd = {dst + 1, dst, n};
+        struct mem_args cmp = {ones, src + 1, n};
+        bench_run(BENCH, "memcpy", n, memcpy_case, &a);
+        bench_run(BENCH, "memcpy/bytes", n, memcpy_bytes_case, &a);
+        bench_run(BENCH, "memset", n, memset_case, &a);
+        bench_run(BENCH, "memset/bytes", n, memset_bytes_case, &a);
+        bench_run(BENCH, "memmove/fwd", n, memmove_case, &fwd);
+        bench_run(BENCH, "memmove/bwd", n, memmove_case, &bwd);
+        bench_run(BENCH, "memcmp", n, memcmp_case, &cmp);
+        bench_run(BENCH, "memcmp/bytes", n, memcmp_bytes_case, &cmp);
+    }
+    bench_free(dst), bench_free(src), bench_free(ones);
+
+    return 0;
+}
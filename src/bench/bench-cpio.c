@@ -0,0 +1,336 @@
+/**
+ * @file
+ * Benchmarks for CPIO decoding and lookup over synthetic archives
+ */
+#include "bench.h"
+
+#include <drivers/devices.h>
+#include <drivers/fileformat/cpio.h>
+#include <drivers/vfs.h>
+
+#include <core/ctype.h>
+#include <core/errno.h>
+#include <core/macros.h>
+#include <core/sprintf.h>
+#include <core/string.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BENCH "bench-cpio"
+
+#define FILES_PER_DIR 100 ///< Synthetic archives have 100 files per directory
+#define FILE_DATA_SZ  64  ///< ...and each file has 64 bytes of data
+
+/** @name Synthetic archive generation */
+///@{
+
+struct archive {
+    char  *buf;
+    size_t size, cap;
+    size_t entries;
+    char   lastpath[PATH_MAX];
+
+    struct cpio_index_ent *ents;   ///< Index entries, in path order
+    struct archive        *strtab; ///< Index string table
+};
+
+static void ar_put(struct archive *ar, const void *src, size_t n)
+{
+    if (ar->size + n > ar->cap) {
+        ar->cap = MAX(ar->cap * 2, ar->size + n);
+        ar->buf = bench_realloc(ar->buf, ar->cap);
+    }
+    memcpy(ar->buf + ar->size, src, n);
+    ar->size += n;
+}
+
+static void ar_pad4(struct archive *ar)
+{
+    static const char zeroes[4];
+    ar_put(ar, zeroes, ALIGN_UP(ar->size, 4) - ar->size);
+}
+
+/** Append a "newc" header and pathname. */
+static void
+ar_put_hdr(struct archive *ar, const char *path, unsigned mode, size_t fsize)
+{
+    char   hdr[sizeof(struct cpio_newc_header) + 1];
+    size_t psize = strlen(path) + 1;
+    /* Header fields are 32 bits, so each one fits in its 8 hex digits. */
+    snprintf(
+            hdr, sizeof(hdr),
+            "070701%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X",
+            (uint32_t) ar->entries, mode, 0, 0, 1, 0, (uint32_t) fsize, 0, 0,
+            0, 0, (uint32_t) psize, 0
+    );
+    ar_put(ar, hdr, sizeof(struct cpio_newc_header));
+    ar_put(ar, path, psize);
+    ar_pad4(ar);
+}
+
+/** Append one "newc" entry: header, pathname, and file data. */
+static void
+ar_add(struct archive *ar, const char *path, unsigned mode, size_t fsize)
+{
+    /* Paths are added in sorted order, like the index tool writes them. */
+    if (ar->strtab && strcmp(path, "TRAILER!!!") != 0) {
+        ar->ents = bench_realloc(ar->ents, (ar->entries + 1) * sizeof(*ar->ents));
+        ar->ents[ar->entries] = (struct cpio_index_ent){
+                .path  = ar->strtab->size,
+                .hoff  = ar->size,
+                .ino   = ar->entries,
+                .mode  = mode,
+                .fsize = fsize,
+        };
+        ar_put(ar->strtab, path, strlen(path) + 1);
+    }
+
+    ar_put_hdr(ar, path, mode, fsize);
+    for (size_t i = 0; i < fsize; i++) ar_put(ar, "x", 1);
+    ar_pad4(ar);
+    ar->entries++;
+}
+
+/** Build a sorted archive like the initrd: directories full of files. */
+static void ar_build(struct archive *ar, size_t nentries)
+{
+    char path[PATH_MAX];
+    *ar        = (struct archive){};
+    ar->strtab = bench_malloc(sizeof(*ar->strtab));
+    *ar->strtab = (struct archive){};
+    ar_add(ar, ".", 0040755, 0);
+    for (size_t d = 0; ar->entries < nentries; d++) {
+        snprintf(path, sizeof(path), "d%04zu", d);
+        ar_add(ar, path, 0040755, 0);
+        for (size_t f = 0; f < FILES_PER_DIR && ar->entries < nentries; f++) {
+            snprintf(path, sizeof(path), "d%04zu/f%03zu", d, f);
+            ar_add(ar, path, 0100644, FILE_DATA_SZ);
+        }
+    }
+    snprintf(ar->lastpath, sizeof(ar->lastpath), "%s", path);
+    ar_add(ar, "TRAILER!!!", 0, 0);
+}
+
+/** Build a copy of an archive with a path index in front, like the initrd. */
+static void ar_build_indexed(struct archive *out, const struct archive *in)
+{
+    size_t nents   = in->entries - 1; // All but the trailer.
+    size_t entsz   = nents * sizeof(struct cpio_index_ent);
+    size_t datasz  = sizeof(struct cpio_index_hdr) + entsz + in->strtab->size;
+    size_t hdrsz   = sizeof(struct cpio_newc_header) + sizeof(CPIO_INDEX_NAME);
+    size_t shift   = ALIGN_UP(ALIGN_UP(hdrsz, 4) + datasz, 4);
+
+    *out = (struct archive){};
+    ar_put_hdr(out, CPIO_INDEX_NAME, 0100444, datasz);
+
+    struct cpio_index_hdr hdr = {
+            .count   = nents,
+            .strtab  = sizeof(hdr) + entsz,
+            .strsize = in->strtab->size,
+    };
+    memcpy(hdr.magic, CPIO_INDEX_MAGIC, CPIO_INDEX_MAGICSZ);
+    ar_put(out, &hdr, sizeof(hdr));
+    for (size_t i = 0; i < nents; i++) {
+        struct cpio_index_ent e = in->ents[i];
+        e.hoff += shift, e.ino++;
+        ar_put(out, &e, sizeof(e));
+    }
+    ar_put(out, in->strtab->buf, in->strtab->size);
+    ar_pad4(out);
+
+    ar_put(out, in->buf, in->size);
+}
+
+/** Put an archive on a ramdisk and mount it */
+static int ar_mount(struct archive *ar, const char *mpath, dev_t *dev)
+{
+    int minor = ramdisk_create(ar->buf, ar->size, "bench");
+    if (minor < 0) return minor;
+    *dev = MAKEDEV(MAJ_RAMDISK, minor);
+    return fs_mountdev(*dev, FS_CPIO, mpath);
+}
+
+///@}
+
+/** @name Reference decoder */
+///@{
+
+/**
+ * Decode a header field one character at a time
+ *
+ * This is how cpiofs used to decode fields, before cpio_hex8(). It is kept
+ * here as the baseline to compare with.
+ */
+static long cpio_atoi(const char *field, size_t n, int base)
+{
+    long ret = 0;
+    for (const char *pos = field; n; pos++, n--) {
+        int  digit;
+        char c = tolower(*pos);
+        if ('0' <= c && c <= '9') digit = c - '0' + 0x0;
+        else if ('a' <= c && c <= 'f') digit = c - 'a' + 0xa;
+        else return -EINVAL;
+        if (digit >= base) return -EINVAL;
+        ret = ret * base + digit;
+    }
+    return ret;
+}
+
+///@}
+
+/** @name Benchmark cases */
+///@{
+
+static void cpio_atoi_case(void *arg)
+{
+    BENCH_KEEP(cpio_atoi(arg, 8, 16));
+}
+
+static void cpio_hex8_case(void *arg)
+{
+    uint32_t val;
+    BENCH_KEEP(cpio_hex8(arg, &val));
+    BENCH_KEEP(val);
+}
+
+struct find_args {
+    struct file *af;
+    const char  *path;
+};
+
+static void cpio_find_path_case(void *arg)
+{
+    struct find_args  *a = arg;
+    struct cpio_header h;
+    file_lseek(a->af, 0, SEEK_SET);
+    BENCH_KEEP(cpio_find_path(a->af, a->path, &h));
+}
+
+static void file_open_path_case(void *arg)
+{
+    struct file f;
+    if (file_open_path(&f, "/", arg) >= 0) file_close(&f);
+}
+
+/** Mount and unmount, which is where cpiofs reads the index or every header */
+static void mount_case(void *arg)
+{
+    if (fs_mountdev(*(dev_t *) arg, FS_CPIO, "/bench-mnt") >= 0)
+        fs_umount("/bench-mnt");
+}
+
+struct cold_args {
+    struct superblock *sb;
+    const char        *path;
+};
+
+/** Open with nothing in the dentry cache */
+static void file_open_cold_case(void *arg)
+{
+    struct cold_args *a = arg;
+    dcache_invalidate_sb(a->sb);
+    file_open_path_case((void *) a->path);
+}
+
+static void file_stat_case(void *arg)
+{
+    struct fstat st;
+    BENCH_KEEP(file_stat(&st, "/", arg));
+}
+
+static void ls_readdir_case(void *arg)
+{
+    struct file   f;
+    struct dirent d;
+    if (file_open_path(&f, "/", arg) < 0) return;
+    while (file_readdir(&f, &d) > 0) BENCH_KEEP(d.d_ino);
+    file_close(&f);
+}
+
+static void ls_getdents_case(void *arg)
+{
+    struct file f;
+    char        buf[4096];
+    ssize_t     len;
+    if (file_open_path(&f, "/", arg) < 0) return;
+    while ((len = file_getdents(&f, buf, sizeof(buf))) > 0) BENCH_KEEP(len);
+    file_close(&f);
+}
+
+///@}
+
+int main(void)
+{
+    bench_init_pages(64 << 20); // Enough for the biggest directory trees.
+    init_driver_ramdisk();
+    init_driver_cpiofs();
+
+    bench_run(BENCH, "cpio_atoi", 8, cpio_atoi_case, "000081a4");
+    bench_run(BENCH, "cpio_hex8", 8, cpio_hex8_case, "000081a4");
+
+    /* Full scans: look up the last entry and a missing entry. */
+    const size_t sizes[] = {10000, 30000, 100000};
+    for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+        struct archive ar;
+        ar_build(&ar, sizes[i]);
+
+        int minor = ramdisk_create(ar.buf, ar.size, "bench");
+        if (minor < 0) return 1;
+
+        struct file af;
+        if (file_open_dev(&af, MAKEDEV(MAJ_RAMDISK, minor)) < 0) return 1;
+
+        struct find_args last = {&af, ar.lastpath};
+        struct find_args miss = {&af, "no/such/file"};
+        bench_run(BENCH, "cpio_find_path/last", sizes[i], cpio_find_path_case,
+                  &last);
+        bench_run(BENCH, "cpio_find_path/missing", sizes[i],
+                  cpio_find_path_case, &miss);
+
+        file_close(&af);
+
+        /* Mounts through cpiofs, with and without a path index. */
+        char mpath[2][32], lastpath[2][2 * PATH_MAX], misspath[PATH_MAX];
+        dev_t dev[2];
+        struct archive idx;
+        ar_build_indexed(&idx, &ar);
+        for (int j = 0; j < 2; j++) {
+            snprintf(mpath[j], sizeof(mpath[j]), "/%s%zu",
+                     j ? "indexed" : "plain", sizes[i]);
+            snprintf(lastpath[j], sizeof(lastpath[j]), "%s/%s", mpath[j], ar.lastpath);
+            if (ar_mount(j ? &idx : &ar, mpath[j], &dev[j]) < 0) return 1;
+        }
+        snprintf(misspath, PATH_MAX, "%s/no/such/file", mpath[0]);
+        struct file f;
+        if (file_open_path(&f, "/", lastpath[1]) < 0) return 1; // Index works.
+        file_close(&f);
+
+        bench_run(BENCH, "mount/plain", sizes[i], mount_case, &dev[0]);
+        bench_run(BENCH, "mount/indexed", sizes[i], mount_case, &dev[1]);
+
+        /* Opens: the tree is the same either way once mounted. */
+        struct vfs_path root, mnt;
+        vfs_path_root(&root);
+        if (vfs_path_lookup(&mnt, &root, mpath[0]) < 0) return 1;
+        struct cold_args cold = {mnt.sb, lastpath[0]};
+        vfs_path_put(&mnt);
+
+        bench_run(BENCH, "open/cold/last", sizes[i], file_open_cold_case,
+                  &cold);
+        bench_run(BENCH, "open/cached/last", sizes[i], file_open_path_case,
+                  lastpath[0]);
+        bench_run(BENCH, "open/cached/missing", sizes[i],
+                  file_open_path_case, misspath);
+        bench_run(BENCH, "stat/cached/last", sizes[i], file_stat_case,
+                  lastpath[0]);
+
+        /* Listings of the top directory, which has one entry per subdir. */
+        bench_run(BENCH, "ls/readdir", sizes[i] / FILES_PER_DIR,
+                  ls_readdir_case, mpath[0]);
+        bench_run(BENCH, "ls/getdents", sizes[i] / FILES_PER_DIR,
+                  ls_getdents_case, mpath[0]);
+    }
+
+    return 0;
+}
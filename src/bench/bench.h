@@ -0,0 +1,49 @@
+/**
+ * @file
+ * Minimal benchmark harness for host builds
+ *
+ * Benchmark programs link our libraries natively on the host machine and time
+ * their hot functions. This lets us spot performance regressions without
+ * building a boot image.
+ *
+ * Each timed case prints one tab-separated line to stdout:
+ *
+ *      bench   case    param   iters   ns_per_op
+ *
+ * - `bench` is the name of the benchmark program, e.g. "bench-core"
+ * - `case` names the function and input being timed, e.g. "strstr/periodic"
+ * - `param` is a size or count for the input (0 if not applicable)
+ * - `iters` is the number of calls that were timed
+ * - `ns_per_op` is the average wall-clock time per call, in nanoseconds
+ *
+ * `make test` runs all benchmarks and collects their output in `bench.tsv`.
+ *
+ * @note
+ *  Our own headers clash with the host's libc headers (e.g. both define
+ *  `dev_t` and `SEEK_SET`), so the benchmark programs only include ours.
+ *  Everything that needs the host's libc lives in harness.c.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+
+/** Keep the compiler from optimizing away an unused result. */
+#define BENCH_KEEP(x) asm volatile("" : : "g"(x) : "memory")
+
+typedef void bench_fn(void *arg);
+
+void bench_run(
+        const char *bench,
+        const char *name,
+        long        param,
+        bench_fn   *fn,
+        void       *arg
+);
+
+void  bench_init_pages(size_t size);
+void *bench_malloc(size_t size);
+void *bench_realloc(void *ptr, size_t size);
+void  bench_free(void *ptr);
+
+#endif /* BENCH_H */
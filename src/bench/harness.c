@@ -0,0 +1,81 @@
+/**
+ * @file
+ * Benchmark harness: timing and memory from the host's libc
+ */
+#include "bench.h"
+
+#include <core/page.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_MIN_NS  (20 * 1000 * 1000) ///< Run each case for at least 20ms
+#define BENCH_MAX_ITS (1ull << 32)       ///< ...but stop doubling here
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Time a benchmark case and print its result line
+ *
+ * Runs the function in batches, doubling the batch size until one batch
+ * takes at least @ref BENCH_MIN_NS. The final batch is reported.
+ */
+void bench_run(
+        const char *bench,
+        const char *name,
+        long        param,
+        bench_fn   *fn,
+        void       *arg
+)
+{
+    for (uint64_t iters = 1;; iters *= 2) {
+        uint64_t start = now_ns();
+        for (uint64_t i = 0; i < iters; i++) fn(arg);
+        uint64_t elapsed = now_ns() - start;
+
+        if (elapsed >= BENCH_MIN_NS || iters >= BENCH_MAX_ITS) {
+            printf("%s\t%s\t%ld\t%llu\t%.2f\n", bench, name, param,
+                   (unsigned long long) iters, (double) elapsed / iters);
+            fflush(stdout);
+            return;
+        }
+    }
+}
+
+/**
+ * Give the kernel page allocator some host memory to hand out.
+ *
+ * Needed by anything that allocates from object caches, such as
+ * ramdisk_create.
+ */
+void bench_init_pages(size_t size)
+{
+    size_t    align = (size_t) PAGE_SIZE << PAGE_MAX_ORDER;
+    uintptr_t lo    = (uintptr_t) bench_malloc(size + align);
+    uintptr_t hi    = lo + size + align;
+    page_init(lo, hi);
+    page_add_range(lo, hi);
+}
+
+void *bench_malloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if (!ptr) perror("malloc"), exit(1);
+    return ptr;
+}
+
+void *bench_realloc(void *ptr, size_t size)
+{
+    ptr = realloc(ptr, size);
+    if (!ptr) perror("realloc"), exit(1);
+    return ptr;
+}
+
+void bench_free(void *ptr) { free(ptr); }
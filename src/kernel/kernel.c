@@ -1,9 +1,14 @@
 #include "kernel.h"
 
 #include "kshell.h"
+#include "process.h"
 
 #include <boot.h>
 #include <cpu.h>
+#include <gdt.h>
+#include <idt.h>
+#include <paging.h>
+#include <tsc.h>
 
 #include <drivers/devices.h>
 #include <drivers/fileformat/ascii.h>
@@ -11,6 +16,8 @@
 #include <drivers/vfs.h>
 
 #include <core/errno.h>
+#include <core/macros.h>
+#include <core/page.h>
 #include <core/string.h>
 #include <core/types.h>
 
@@ -18,6 +25,11 @@
 
 static struct file      serial1;
 static struct boot_info boot_info;
+static uintptr_t        mem_end; ///< End of usable physical memory
+
+extern char __executable_start[], _end[]; ///< Kernel image, from linker
+
+#define LOW_MEM_END 0x100000 ///< Leave the first 1 MiB (BIOS, VGA) alone
 
 static int init_log(void)
 {
@@ -33,6 +45,101 @@ static int init_log(void)
     return 0;
 }
 
+typedef void mem_range_fn(uintptr_t start, uintptr_t end);
+
+/** Call fn for each part of a memory range that is not reserved */
+static void foreach_free_range(
+        uintptr_t                    start,
+        uintptr_t                    end,
+        const struct boot_mem_range *reserved,
+        size_t                       n,
+        mem_range_fn                *fn
+)
+{
+    for (size_t i = 0; i < n && start < end; i++) {
+        const struct boot_mem_range *r = &reserved[i];
+        if (r->end <= start || r->start >= end) continue;
+        /* Split around the reserved range and check the rest of the list. */
+        if (start < r->start)
+            foreach_free_range(
+                    start, r->start, reserved + i + 1, n - i - 1, fn
+            );
+        start = r->end;
+    }
+    if (start < end) fn(start, end);
+}
+
+static struct boot_mem_range largest; ///< Largest free range
+
+static void find_largest(uintptr_t start, uintptr_t end)
+{
+    if (end - start > largest.end - largest.start)
+        largest = (struct boot_mem_range){start, end};
+}
+
+static void add_mem_range(uintptr_t start, uintptr_t end)
+{
+    if (start == largest.start) return; // Already added.
+    int res = page_add_range(start, end);
+    if (res < 0)
+        pr_warning("lost memory %#zx-%#zx: %s\n", start, end, strerror(-res));
+}
+
+/** Give available memory to the page allocator, except what is in use */
+static int init_memory(void)
+{
+    int res;
+
+    res = boot_info.mem_avail_count ? 0 : -ENODEV;
+    log_result(res, "get memory map provided by bootloader\n");
+    if (res < 0) return res;
+
+    /* Ranges that are in use and must never be handed out. */
+    uintptr_t initrd = (uintptr_t) boot_info.initrd_addr;
+    const struct boot_mem_range reserved[] = {
+            {0, LOW_MEM_END},
+            {(uintptr_t) __executable_start, (uintptr_t) _end},
+            {initrd, initrd + boot_info.initrd_size},
+    };
+
+    /* Find span of all available memory. Only the kernel half of the
+     * address space is identity-mapped, so memory above it is unusable. */
+    uintptr_t lo = UINTPTR_MAX, hi = 0;
+    for (unsigned i = 0; i < boot_info.mem_avail_count; i++) {
+        lo = MIN(lo, boot_info.mem_avail[i].start);
+        hi = MAX(hi, boot_info.mem_avail[i].end);
+    }
+    mem_end = MIN(hi, KERNEL_SPLIT);
+    res     = page_init(MAX(lo, LOW_MEM_END), mem_end);
+    if (res < 0) return res;
+
+    /* The allocator takes its metadata from the first range it is given,
+     * so give it the largest one first. Then add the rest. */
+    for (unsigned i = 0; i < boot_info.mem_avail_count; i++) {
+        foreach_free_range(
+                boot_info.mem_avail[i].start, boot_info.mem_avail[i].end,
+                reserved, ARRAY_SIZE(reserved), find_largest
+        );
+    }
+    res = page_add_range(largest.start, largest.end);
+    log_result(
+            res, "page allocator metadata in %#zx-%#zx\n", largest.start,
+            largest.end
+    );
+    if (res < 0) return res;
+    for (unsigned i = 0; i < boot_info.mem_avail_count; i++) {
+        foreach_free_range(
+                boot_info.mem_avail[i].start, boot_info.mem_avail[i].end,
+                reserved, ARRAY_SIZE(reserved), add_mem_range
+        );
+    }
+
+    struct page_stats st;
+    page_get_stats(&st);
+    pr_info("page allocator: %lu KiB free\n", st.free * (PAGE_SIZE / 1024));
+    return 0;
+}
+
 static int mount_initrd(void)
 {
     int res;
@@ -60,7 +167,13 @@ int kernel_main(void)
     res = init_driver_serial();
     if (res < 0) return res;
     init_log();
+    init_clock_tsc();
     read_boot_info(&boot_info);
+    init_gdt();
+    init_idt();
+    init_memory();
+    init_paging(mem_end);
+    init_process();
 
     /* Init more essential drivers. */
     init_driver_ramdisk();
@@ -70,6 +183,9 @@ int kernel_main(void)
     /* Mount init ramdisk. */
     mount_initrd();
 
+    /* Write out log records from boot. */
+    log_flush();
+
     /* Start shell. */
     kshell_init_run();
 
@@ -13,15 +13,19 @@
 #include <core/errno.h>
 #include <core/list.h>
 #include <core/macros.h>
+#include <core/page.h>
+#include <core/slab.h>
 #include <core/sprintf.h>
 #include <core/string.h>
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define SH_PREFIX    "kshell: "
 #define SH_LINEBUFSZ 256
 #define SH_ARGVSZ    16
+#define SH_LSBUFSZ   1024
 #define SH_TTYFLAGS  (TTY_ECHO | TTY_COOKED)
 
 typedef int shcmd_fn(struct kshell *sh, int argc, char *argv[]);
@@ -134,7 +138,8 @@ static int cmd_inputtest(struct kshell *sh, int argc, char *argv[])
     if (res < 0) return res;
 
     /* Read and echo characters. */
-    char descbuf[SH_LINEBUFSZ];
+    char *descbuf = arena_alloc(&sh->scratch, SH_LINEBUFSZ);
+    if (!descbuf) return -ENOMEM;
     file_debugstr(descbuf, SH_LINEBUFSZ, sh->in);
     file_printf(sh->out, "Reading from %s. Press CTRL-D to stop.\n", descbuf);
     int testres;
@@ -155,34 +160,86 @@ static int cmd_inputtest(struct kshell *sh, int argc, char *argv[])
     return 0;
 }
 
+static int mount_maxpathlen(struct superblock *sb, void *ctx)
+{
+    int *maxpathlen = ctx;
+    *maxpathlen     = MAX(*maxpathlen, (int) strlen(sb->s_mountpath));
+    return 0;
+}
+
+struct mount_print_ctx {
+    struct kshell *sh;
+    int            maxpathlen;
+};
+
+static int mount_print(struct superblock *sb, void *ctx)
+{
+    struct mount_print_ctx *pc = ctx;
+    file_printf(
+            pc->sh->out, "%-*s = %s (type %s)\n", pc->maxpathlen,
+            sb->s_mountpath, sb->s_name, sb->s_op->name
+    );
+    return 0;
+}
+
 static int cmd_mount(struct kshell *sh, int argc, char *argv[])
 {
     UNUSED(argc);
     UNUSED(argv);
 
-    struct superblock *sb;
+    struct mount_print_ctx pc = {.sh = sh};
+    vfs_mount_foreach(mount_maxpathlen, &pc.maxpathlen);
+    return vfs_mount_foreach(mount_print, &pc);
+}
 
-    int maxpathlen = 0;
-    list_for_each_entry(sb, &vfs_mount_list, s_mount_list)
-    {
-        maxpathlen = MAX(maxpathlen, (int) strlen(sb->s_mountpath));
-    }
+static int cmd_umount(struct kshell *sh, int argc, char *argv[])
+{
+    int res;
 
-    list_for_each_entry(sb, &vfs_mount_list, s_mount_list)
-    {
-        file_printf(
-                sh->out, "%-*s = %s (type %s)\n", maxpathlen, sb->s_mountpath,
-                sb->s_name, sb->s_op->name
-        );
+    if (argc < 2) {
+        file_printf(sh->err, "usage: %s PATH\n", argv[0]);
+        return 1;
     }
-    return 0;
+
+    res = fs_umount(argv[1]);
+    reporterr(sh, res, "%s\n", argv[1]);
+    return res;
 }
 
 static int cmd_pwd(struct kshell *sh, int argc, char *argv[])
 {
     UNUSED(argc);
     UNUSED(argv);
-    file_printf(sh->out, "%s\n", sh->cwd);
+
+    /* Paths can be longer than PATH_MAX, so measure first. */
+    int   len = vfs_path_name(NULL, 0, &sh->cwd);
+    char *buf = arena_alloc(&sh->scratch, len + 1);
+    if (!buf) return -ENOMEM;
+    vfs_path_name(buf, len + 1, &sh->cwd);
+    file_printf(sh->out, "%s\n", buf);
+    return 0;
+}
+
+static int cmd_cd(struct kshell *sh, int argc, char *argv[])
+{
+    int res;
+
+    const char *dirpath = argc >= 2 ? argv[1] : "/";
+
+    struct vfs_path dir;
+    res = vfs_path_lookup(&dir, &sh->cwd, dirpath);
+    reporterr(sh, res, "%s\n", dirpath);
+    if (res < 0) return res;
+
+    res = dir.dentry->d_inode->i_stat.f_type == DT_DIR ? 0 : -ENOTDIR;
+    reporterr(sh, res, "%s\n", dirpath);
+    if (res < 0) {
+        vfs_path_put(&dir);
+        return res;
+    }
+
+    vfs_path_put(&sh->cwd);
+    sh->cwd = dir;
     return 0;
 }
 
@@ -195,16 +252,25 @@ static int cmd_ls(struct kshell *sh, int argc, char *argv[])
     else dirpath = NULL;
 
     struct file dir;
-    res = file_open_path(&dir, sh->cwd, dirpath);
+    res = file_openat(&dir, &sh->cwd, dirpath);
     if (res < 0) goto exit;
     dir_isopen = 1;
 
-    struct dirent de;
+    /* Read entries in batches, and print each batch. */
+    char *buf = arena_alloc(&sh->scratch, SH_LSBUFSZ);
+    res       = buf ? 0 : -ENOMEM;
+    if (res < 0) goto exit;
     for (;;) {
-        res = file_readdir(&dir, &de);
+        res = file_getdents(&dir, buf, SH_LSBUFSZ);
         if (res < 0) goto exit;
         if (res == 0) break;
-        file_printf(sh->out, "%s%s\n", de.d_name, ftype_marker(de.d_type));
+        for (char *pos = buf, *end = buf + res; pos < end;) {
+            struct dirent_rec *de = (struct dirent_rec *) pos;
+            file_printf(
+                    sh->out, "%s%s\n", de->d_name, ftype_marker(de->d_type)
+            );
+            pos += de->d_reclen;
+        }
     }
 
 exit:
@@ -223,7 +289,7 @@ static int cmd_stat(struct kshell *sh, int argc, char *argv[])
 
     const char  *filepath = argv[1];
     struct fstat fstat;
-    res = file_stat(&fstat, sh->cwd, filepath);
+    res = file_statat(&fstat, &sh->cwd, filepath);
     reporterr(sh, res, "file not found\n");
     if (res < 0) return res;
 
@@ -244,16 +310,18 @@ static int cmd_xhead(struct kshell *sh, int argc, char *argv[])
 
     const char *filepath = argv[1];
     struct file f;
-    res = file_open_path(&f, sh->cwd, filepath);
+    res = file_openat(&f, &sh->cwd, filepath);
     if (res < 0) goto exit;
     f_isopen = 1;
 
-    const int rowbytes = 16;
-    const int rows     = 10;
-    loff_t    off      = 0;
+    const int      rowbytes = 16;
+    const int      rows     = 10;
+    loff_t         off      = 0;
+    unsigned char *rowbuf   = arena_alloc(&sh->scratch, rowbytes);
+    res                     = rowbuf ? 0 : -ENOMEM;
+    if (res < 0) goto exit;
     for (int i = 0; i < rows; i++) {
         /* Read one row worth of bytes. */
-        unsigned char rowbuf[rowbytes];
         res = file_read(&f, rowbuf, rowbytes);
         if (res < 0) goto exit;
         if (res == 0) break;
@@ -304,6 +372,95 @@ static int cmd_reset(struct kshell *sh, int argc, char *argv[])
     return 0;
 }
 
+static int cmd_dmesg(struct kshell *sh, int argc, char *argv[])
+{
+    UNUSED(argc);
+    UNUSED(argv);
+    int res = log_dump(sh->out);
+    reporterr(sh, res, "could not print log\n");
+    return res;
+}
+
+static int cmd_loglevel(struct kshell *sh, int argc, char *argv[])
+{
+    int res;
+
+    if (argc == 1) return log_print_levels(sh->out);
+    if (argc != 3) {
+        file_printf(sh->err, "usage: %s [MODULE|all LEVEL]\n", argv[0]);
+        return 1;
+    }
+
+    res = log_parse_level(argv[2]);
+    reporterr(sh, res, "unknown log level: %s\n", argv[2]);
+    if (res < 0) return res;
+
+    res = log_set_level(argv[1], res);
+    reporterr(sh, res, "no log sites in module: %s\n", argv[1]);
+    if (res < 0) return res;
+
+    file_printf(sh->out, "%s: set %d log sites to %s\n", argv[1], res, argv[2]);
+    return 0;
+}
+
+static int cmd_meminfo(struct kshell *sh, int argc, char *argv[])
+{
+    UNUSED(argc);
+    UNUSED(argv);
+
+    struct page_stats st;
+    page_get_stats(&st);
+
+    const unsigned kib = PAGE_SIZE / 1024;
+    size_t         used = st.total - st.free;
+    file_printf(sh->out, "Total: %8zu pages %10zu KiB\n", st.total,
+                st.total * kib);
+    file_printf(sh->out, "Used:  %8zu pages %10zu KiB\n", used, used * kib);
+    file_printf(sh->out, "Free:  %8zu pages %10zu KiB\n", st.free,
+                st.free * kib);
+
+    file_printf(sh->out, "Free blocks by order:");
+    for (unsigned i = 0; i <= PAGE_MAX_ORDER; i++)
+        file_printf(sh->out, " %zu", st.blocks[i]);
+    file_printf(sh->out, "\n");
+
+    /* Internal fragmentation: bytes lost to rounding up to a size class. */
+    struct kmalloc_stats ks;
+    kmalloc_get_stats(&ks);
+    unsigned waste = 0;
+    if (ks.allocated)
+        waste = (uint64_t) (ks.allocated - ks.requested) * 100 / ks.allocated;
+    file_printf(sh->out, "Heap:  %zu bytes live, %zu large pages\n", ks.live,
+                ks.large_pages);
+    file_printf(sh->out, "Heap:  %zu allocs, %zu frees, %zu failed, %u%% "
+                "lost to rounding\n", ks.allocs, ks.frees, ks.failed, waste);
+    if (SLAB_DEBUG)
+        file_printf(sh->out, "Heap:  %zu poison errors\n", ks.poison_errors);
+
+    file_printf(sh->out, "Shell scratch: %zu bytes peak\n", sh->scratch.peak);
+    return 0;
+}
+
+static int cmd_slabinfo(struct kshell *sh, int argc, char *argv[])
+{
+    UNUSED(argc);
+    UNUSED(argv);
+
+    file_printf(sh->out, "%-12s %6s %6s %6s %5s %8s %8s\n", "cache", "active",
+                "total", "objsz", "slabs", "allocs", "hit%");
+
+    struct kmem_cache *c;
+    list_for_each_entry(c, &kmem_cache_list, caches)
+    {
+        const struct kmem_cache_stats *st = &c->stats;
+        unsigned hitpct = st->allocs ? st->hits * 100 / st->allocs : 0;
+        file_printf(sh->out, "%-12s %6zu %6zu %6zu %5zu %8zu %7u%%\n",
+                    c->name, st->active, st->total, c->objsize, st->slabs,
+                    st->allocs, hitpct);
+    }
+    return 0;
+}
+
 static int cmd_help(struct kshell *sh, int argc, char *argv[])
 {
     UNUSED(argc);
@@ -313,9 +470,15 @@ static int cmd_help(struct kshell *sh, int argc, char *argv[])
 
 static const struct shcmd KSH_CMDS[] = {
         {"help", cmd_help},
+        {"dmesg", cmd_dmesg},
+        {"loglevel", cmd_loglevel},
+        {"meminfo", cmd_meminfo},
+        {"slabinfo", cmd_slabinfo},
         {"inputtest", cmd_inputtest},
         {"mount", cmd_mount},
+        {"umount", cmd_umount},
         {"pwd", cmd_pwd},
+        {"cd", cmd_cd},
         {"ls", cmd_ls},
         {"stat", cmd_stat},
         {"xhead", cmd_xhead},
@@ -355,7 +518,8 @@ int kshell_init_tty(struct kshell *sh, struct file *tty)
 {
     int res;
     *sh = (struct kshell){.in = tty, .out = tty, .err = tty};
-    snprintf(sh->cwd, PATH_MAX, "%s", "/");
+    vfs_path_root(&sh->cwd);
+    arena_init(&sh->scratch, 0);
 
     char buf[SH_LINEBUFSZ];
     file_printf(
@@ -368,7 +532,7 @@ int kshell_init_tty(struct kshell *sh, struct file *tty)
     return res;
 }
 
-int kshell_read_exec(struct kshell *sh)
+static int kshell_read_exec_inner(struct kshell *sh)
 {
     int res;
 
@@ -379,8 +543,9 @@ int kshell_read_exec(struct kshell *sh)
     }
 
     /* Read line. */
-    char linebuf[SH_LINEBUFSZ];
-    res = file_readstr(sh->in, linebuf, sizeof(linebuf));
+    char *linebuf = arena_alloc(&sh->scratch, SH_LINEBUFSZ);
+    if (!linebuf) return -ENOMEM;
+    res = file_readstr(sh->in, linebuf, SH_LINEBUFSZ);
     if (res == -EAGAIN) return res;
     reporterr(sh, res, "could not read command line\n");
     if (res < 0) return res;
@@ -389,8 +554,9 @@ int kshell_read_exec(struct kshell *sh)
     sh->waiting_for_input = 0;
 
     /* Parse line into arguments. */
-    char *argv[SH_ARGVSZ];
-    int   argc = sh_break_cmdline(linebuf, argv, SH_ARGVSZ);
+    char **argv = arena_alloc(&sh->scratch, SH_ARGVSZ * sizeof(*argv));
+    if (!argv) return -ENOMEM;
+    int argc = sh_break_cmdline(linebuf, argv, SH_ARGVSZ);
     reporterr(sh, res, "could not parse command line\n");
     if (argc < 0) return argc;
     if (argc == 0) return -EAGAIN;
@@ -407,8 +573,16 @@ int kshell_read_exec(struct kshell *sh)
     const char *bindir = kshell_search_bin(sh, argv[0]);
     if (bindir) {
         struct process *p = process_alloc();
-        res               = process_load_path(p, bindir, argv[0]);
+        res               = p ? 0 : -ENOMEM;
+        reporterr(sh, res, "could not allocate process\n");
+        if (res < 0) return -EAGAIN;
+
+        res = process_load_path(p, &sh->scratch, bindir, argv[0]);
         reporterr(sh, res, "could not load %s\n", argv[0]);
+        if (res < 0) {
+            process_close(p);
+            return -EAGAIN;
+        }
         res = process_start(p, argc, argv);
         reporterr(sh, res, "%s exited with code %d\n", argv[0], res);
         process_close(p);
@@ -421,9 +595,21 @@ int kshell_read_exec(struct kshell *sh)
     return -EAGAIN;
 }
 
+int kshell_read_exec(struct kshell *sh)
+{
+    /* Free everything that the command allocated from scratch memory. */
+    struct arena_mark m   = arena_mark(&sh->scratch);
+    int               res = kshell_read_exec_inner(sh);
+    arena_release(&sh->scratch, m);
+    return res;
+}
+
 int kshell_run(struct kshell *sh)
 {
     for (;;) {
+        /* Drain the log while waiting for input, not while working. */
+        log_flush();
+
         int res = kshell_read_exec(sh);
         if (res == -EAGAIN) continue;
         if (res < 0) return res;
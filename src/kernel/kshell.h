@@ -3,10 +3,13 @@
 
 #include <drivers/vfs.h>
 
+#include <core/arena.h>
+
 struct kshell {
-    struct file *in, *out, *err;
-    char         cwd[PATH_MAX];
-    int          waiting_for_input;
+    struct file    *in, *out, *err;
+    struct vfs_path cwd; ///< Working directory
+    int             waiting_for_input;
+    struct arena    scratch; ///< Per-command memory, freed on return
 };
 
 int kshell_init_tty(struct kshell *sh, struct file *tty);
@@ -1,4 +1,4 @@
-#define LOG_LEVEL LOG_DEBUG
+// #define LOG_LEVEL LOG_DEBUG
 
 #include "process.h"
 
@@ -11,25 +11,133 @@
 #include <drivers/log.h>
 #include <drivers/vfs.h>
 
+#include <core/compiler.h>
 #include <core/errno.h>
 #include <core/inttypes.h>
 #include <core/macros.h>
+#include <core/page.h>
 #include <core/path.h>
+#include <core/slab.h>
 #include <core/sprintf.h>
 #include <core/string.h>
 
-#define PROCESS_MAX 8
-static struct process pcb[PROCESS_MAX];
-static pid_t          next_pid = 1;
+#include <stdbool.h>
+
+static KMEM_CACHE(pcb_cache, "process", struct process, NULL);
+static pid_t next_pid = 1;
+
+static struct process *current_process; ///< Process that is running, if any
+
+/** Check whether a segment overlaps the virtual range [va, va + n) */
+static inline bool seg_overlaps(const Elf32_Phdr *seg, uintptr_t va, size_t n)
+{
+    return seg->p_vaddr < va + n && va < seg->p_vaddr + seg->p_memsz;
+}
+
+/**
+ * Find file memory that can be mapped in place as a page of a segment.
+ *
+ * Only works for a read-only page whose part of the segment is entirely
+ * file-backed, and only if the file sits in memory (e.g. on the initrd) at
+ * a page-aligned address. The rest of the page is whatever follows in the
+ * file, just as if the whole page had been read from it.
+ */
+static int seg_xip_addr(
+        struct process *p, const Elf32_Phdr *seg, uintptr_t va, uintptr_t *pa
+)
+{
+    if (seg->p_flags & PF_W) return -EINVAL;
+    if (MIN(va + PAGE_SIZE, seg->p_vaddr + seg->p_memsz)
+        > seg->p_vaddr + seg->p_filesz)
+        return -EINVAL; // Page has bss.
+    if (va < seg->p_vaddr && seg->p_vaddr - va > seg->p_offset)
+        return -EINVAL; // Page starts before the file does.
+
+    loff_t off = (loff_t) seg->p_offset + va - seg->p_vaddr;
+    int    res = file_phys_addr(&p->execfile, off, PAGE_SIZE, pa);
+    if (res < 0) return res;
+    return IS_ALIGNED(*pa, PAGE_SIZE) ? 0 : -EINVAL;
+}
+
+/**
+ * Page in a page of the running process on first touch.
+ *
+ * If the page belongs to one read-only segment and the executable's data is
+ * already in memory at a page boundary, the page is mapped in place with no
+ * copy (execute in place). Otherwise, it is built in a fresh zeroed frame
+ * from every segment that overlaps it: file-backed bytes are read from the
+ * executable, and bss stays zero. The page is writable if any of those
+ * segments is.
+ */
+ATTR_CALLED_FROM_ISR static int
+process_fault(uintptr_t addr, unsigned err)
+{
+    struct process *p = current_process;
+    if (!p || err & PFERR_PRESENT) return -EFAULT;
+
+    uintptr_t         va    = ALIGN_DOWN(addr, PAGE_SIZE);
+    unsigned          flags = 0, nover = 0;
+    const Elf32_Phdr *seg   = NULL;
+    for (unsigned i = 0; i < p->nsegs; i++) {
+        if (!seg_overlaps(&p->segs[i], va, PAGE_SIZE)) continue;
+        flags |= PG_U | PG_OWNED;
+        if (p->segs[i].p_flags & PF_W) flags |= PG_RW;
+        seg = &p->segs[i], nover++;
+    }
+    if (!flags) return -EFAULT;
+
+    int       res;
+    uintptr_t pa;
+    if (nover == 1 && seg_xip_addr(p, seg, va, &pa) == 0) {
+        res = pgdir_map(p->pgdir, va, pa, PG_U); // Not owned: no free.
+        if (res < 0) return res;
+        p->xip_pages++;
+        return 0;
+    }
+
+    char *frame = page_alloc(0);
+    if (!frame) return -ENOMEM;
+    memset(frame, 0, PAGE_SIZE);
+
+    res = 0;
+    for (unsigned i = 0; i < p->nsegs && res >= 0; i++)
+        res = elf_read_seg32(&p->execfile, &p->segs[i], va, PAGE_SIZE, frame);
+    if (res >= 0) res = pgdir_map(p->pgdir, va, (uintptr_t) frame, flags);
+    if (res < 0) {
+        page_free(frame);
+        return res;
+    }
+
+    p->faults++;
+    return 0;
+}
+
+/** Set up demand paging for processes (needs paging to be on) */
+int init_process(void)
+{
+    paging_set_fault_handler(process_fault);
+    return 0;
+}
 
 struct process *process_alloc(void)
 {
-    for (int i = 0; i < PROCESS_MAX; i++)
-        if (!pcb[i].pid) return &pcb[i];
-    return NULL;
+    struct process *p = kmem_cache_alloc(&pcb_cache);
+    if (p) *p = (struct process){};
+    return p;
 }
 
-int process_load_path(struct process *p, const char *cwd, const char *path)
+/**
+ * Load a program from a file
+ *
+ * Temporary data, such as the program header table, is allocated from the
+ * caller's scratch arena.
+ */
+int process_load_path(
+        struct process *p,
+        struct arena   *scratch,
+        const char     *cwd,
+        const char     *path
+)
 {
     int res, file_isopen = 0;
 
@@ -37,6 +145,11 @@ int process_load_path(struct process *p, const char *cwd, const char *path)
     *p = (struct process){.pid = next_pid++};
     path_basename(p->name, DEBUGSTR_MAX, path);
 
+    /* Create address space. */
+    p->pgdir = pgdir_create();
+    res      = p->pgdir ? 0 : -ENOMEM;
+    if (res < 0) goto error;
+
     /* Open file. */
     res = file_open_path(&p->execfile, cwd, path);
     if (res < 0) goto error;
@@ -48,29 +161,59 @@ int process_load_path(struct process *p, const char *cwd, const char *path)
     if (res < 0) goto error;
     p->start_addr = ehdr.e_entry;
 
-    /* Load segments. */
+    /* Read program headers. */
+    Elf32_Phdr *phdrs = arena_alloc(scratch, ehdr.e_phnum * sizeof(*phdrs));
+    res               = phdrs ? 0 : -ENOMEM;
+    if (res < 0) goto error;
     for (int i = 0; i < ehdr.e_phnum; i++) {
-        Elf32_Phdr phdr;
-        res = elf_read_phdr32(&p->execfile, &ehdr, i, &phdr);
+        res = elf_read_phdr32(&p->execfile, &ehdr, i, &phdrs[i]);
         if (res < 0) goto error;
+    }
+
+    /* Record loadable segments. Nothing is read yet: pages are read in
+     * from the file when the process first touches them. */
+    unsigned nload = 0;
+    for (int i = 0; i < ehdr.e_phnum; i++) nload += phdrs[i].p_type == PT_LOAD;
+    p->segs = kmalloc(nload * sizeof(*p->segs));
+    res     = p->segs || !nload ? 0 : -ENOMEM;
+    if (res < 0) goto error;
 
-        /* Skip non-load segments. */
-        if (phdr.p_type != PT_LOAD) continue;
+    bool entry_ok = false;
+    for (int i = 0; i < ehdr.e_phnum; i++) {
+        Elf32_Phdr *ph = &phdrs[i];
+        if (ph->p_type != PT_LOAD) continue;
 
-            /* Load. */
-        TODO();
+        /* Segment must be in the user half, and no bigger than it. */
+        uintptr_t end = ph->p_vaddr + ph->p_memsz;
+        bool      ok  = ph->p_vaddr >= USER_BASE && end >= ph->p_vaddr;
+        res           = ok && ph->p_filesz <= ph->p_memsz ? 0 : -ENOEXEC;
+        if (res < 0) goto error;
+
+        entry_ok |= seg_overlaps(ph, p->start_addr, 1);
+        p->segs[p->nsegs++] = *ph;
     }
+    res = entry_ok ? 0 : -ENOEXEC;
+    if (res < 0) goto error;
 
     return 0;
 error:
     if (file_isopen) file_close(&p->execfile);
+    p->execfile = (struct file){};
+    pgdir_destroy(p->pgdir);
+    p->pgdir = NULL;
+    kfree(p->segs);
+    p->segs  = NULL;
+    p->nsegs = 0;
     return res;
 }
 
+/** Close a process's files and free its process control block */
 void process_close(struct process *p)
 {
     file_close(&p->execfile);
-    *p = (struct process){};
+    pgdir_destroy(p->pgdir);
+    kfree(p->segs);
+    kmem_cache_free(&pcb_cache, p);
 }
 
 typedef int main_fn(int argc, char *argv[]);
@@ -85,10 +228,20 @@ int process_start(struct process *p, int argc, char *argv[])
 
     switch (start_strat) {
     case PSTART_CALL: {
-        /* Start process via simple function call. */
-        UNUSED(p), UNUSED(argc), UNUSED(argv);
-        TODO();
-        return -ENOTSUP;
+        /* Start process via simple function call, in its address space.
+         * Its pages are faulted in as it runs. */
+        struct process *prev = current_process;
+        current_process      = p;
+        pgdir_switch(p->pgdir);
+
+        main_fn *entry = (main_fn *) p->start_addr;
+        int      ret   = entry(argc, argv);
+
+        pgdir_switch(prev ? prev->pgdir : NULL);
+        current_process = prev;
+        pr_info("%s: %zu pages copied in, %zu mapped in place\n", p->name,
+                p->faults, p->xip_pages);
+        return ret;
     }
     };
 
@@ -2,9 +2,13 @@
 #define PROCESS_H
 
 #include <abi.h>
+#include <paging.h>
 
 #include <drivers/vfs.h>
 
+#include <oss/elf.h>
+
+#include <core/arena.h>
 #include <core/types.h>
 
 #include <stdint.h>
@@ -17,11 +21,22 @@ struct process {
 
     pid_t     pid;
     uintptr_t start_addr;
+    pde_t    *pgdir; ///< Address space
 
+    Elf32_Phdr *segs;      ///< Loadable segments, paged in on first touch
+    unsigned    nsegs;     ///< Number of loadable segments
+    size_t      faults;    ///< Pages copied in so far
+    size_t      xip_pages; ///< Pages mapped in place from file memory
 };
 
+int             init_process(void);
 struct process *process_alloc(void);
-int  process_load_path(struct process *p, const char *cwd, const char *path);
+int  process_load_path(
+        struct process *p,
+        struct arena   *scratch,
+        const char     *cwd,
+        const char     *path
+);
 int  process_start(struct process *p, int argc, char *argv[]);
 void process_close(struct process *p);
 
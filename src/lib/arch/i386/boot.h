@@ -6,6 +6,15 @@
 #define ARCH_BOOT_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+#define BOOT_MEM_MAX 16 ///< Max number of available memory regions recorded
+
+/** A range of physical memory, [start, end) */
+struct boot_mem_range {
+    uintptr_t start;
+    uintptr_t end;
+};
 
 struct boot_info {
     void    *kernel_location;
@@ -14,6 +23,10 @@ struct boot_info {
     void    *text_fb_addr;
     unsigned text_fb_width;
     unsigned text_fb_height;
+
+    /** Memory regions that the bootloader reports as available */
+    struct boot_mem_range mem_avail[BOOT_MEM_MAX];
+    unsigned              mem_avail_count;
 };
 
 int kernel_main(void);
@@ -40,6 +40,23 @@ static const char *mmap_typestr(unsigned mmap_type)
     // clang-format on
 }
 
+/** Record an available memory region, clipped to what we can address */
+static void add_mem_avail(struct boot_info *b, uint64_t addr, uint64_t len)
+{
+    uint64_t end = addr + len;
+    if (end > UINTPTR_MAX) end = ALIGN_DOWN(UINTPTR_MAX, 4096);
+    if (end <= addr) return;
+
+    if (b->mem_avail_count >= BOOT_MEM_MAX) {
+        pr_warning("too many memory regions, ignoring %#llx\n", addr);
+        return;
+    }
+    b->mem_avail[b->mem_avail_count++] = (struct boot_mem_range){
+            .start = addr,
+            .end   = end,
+    };
+}
+
 /**
  * Read Multiboot2 tags and copy relevant info
  *
@@ -83,6 +100,17 @@ int read_boot_info(struct boot_info *b)
             break;
         }
 
+        case MULTIBOOT_TAG_TYPE_MODULE: {
+            struct multiboot_tag_module *mod = (void *) tag;
+            pr_info("tag: module %#x-%#x \"%s\"\n",
+                    mod->mod_start, mod->mod_end, mod->cmdline);
+            if (!b->initrd_addr) {
+                b->initrd_addr = (void *) (uintptr_t) mod->mod_start;
+                b->initrd_size = mod->mod_end - mod->mod_start;
+            }
+            break;
+        }
+
         case MULTIBOOT_TAG_TYPE_BASIC_MEMINFO: {
             struct multiboot_tag_basic_meminfo *meminfo = (void *) tag;
             pr_info("tag: mem info: lower=%uk, upper=%uk\n",
@@ -110,6 +138,8 @@ int read_boot_info(struct boot_info *b)
                 struct multiboot_mmap_entry *e = &mmap->entries[i];
                 pr_info("\tentry: %#10llx: %#10llx bytes type %u %s\n",
                         e->addr, e->len, e->type, mmap_typestr(e->type));
+                if (e->type == MULTIBOOT_MEMORY_AVAILABLE)
+                    add_mem_avail(b, e->addr, e->len);
             }
             break;
         }
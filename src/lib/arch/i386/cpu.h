@@ -4,6 +4,7 @@
 #include <core/compiler.h>
 #include <core/inttypes.h>
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -69,4 +70,81 @@ static inline void outl(uint32_t val, ioport_t port) { IO_OUT(val, port); }
 
 static inline void cpu_halt(void) { asm inline volatile("hlt"); }
 
+/** Read the Time Stamp Counter (check for TSC support first) */
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    asm inline volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return (uint64_t) hi << 32 | lo;
+}
+
+/** Run the CPUID instruction (check for CPUID support first) */
+static inline void cpuid(
+        uint32_t leaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d
+)
+{
+    asm inline volatile("cpuid"
+                        : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+                        : "a"(leaf), "c"(0));
+}
+
+#define EFLAGS_ID     (1u << 21) ///< EFLAGS: CPUID instruction is available
+#define CPUID1_D_PSE  (1u << 3)  ///< CPUID leaf 1, EDX: 4 MiB pages
+#define CPUID1_D_TSC  (1u << 4)  ///< CPUID leaf 1, EDX: Time Stamp Counter
+#define CPUID1_D_PGE  (1u << 13) ///< CPUID leaf 1, EDX: Global pages
+
+/** Check if the CPUID instruction is available (i486 and up may have it) */
+static inline bool cpu_has_cpuid(void)
+{
+    /* Try to flip the ID bit in EFLAGS. If it sticks, we have CPUID. */
+    ureg_t before, after;
+    asm inline volatile("pushf\n"
+                        "pop	%[before]\n"
+                        "mov	%[before],	%[after]\n"
+                        "xor	%[id],	%[after]\n"
+                        "push	%[after]\n"
+                        "popf\n"
+                        "pushf\n"
+                        "pop	%[after]\n"
+                        "push	%[before]\n"
+                        "popf\n"
+                        : [before] "=&r"(before), [after] "=&r"(after)
+                        : [id] "i"(EFLAGS_ID)
+                        : "cc");
+    return (before ^ after) & EFLAGS_ID;
+}
+
+/** @name Control registers */
+///@{
+
+#define CR0_WP  (1u << 16) ///< CR0: Write-protect read-only pages in ring 0
+#define CR0_PG  (1u << 31) ///< CR0: Paging enabled
+#define CR4_PSE (1u << 4)  ///< CR4: Allow 4 MiB pages (needs CPUID PSE)
+#define CR4_PGE (1u << 7)  ///< CR4: Allow global pages (needs CPUID PGE)
+
+#define CR_ACCESSORS(CR) \
+    static inline ureg_t read_##CR(void) \
+    { \
+        ureg_t val; \
+        asm volatile("mov	%%" #CR ",	%0" : "=r"(val)); \
+        return val; \
+    } \
+    static inline void write_##CR(ureg_t val) \
+    { \
+        asm volatile("mov	%0,	%%" #CR : : "r"(val) : "memory"); \
+    }
+
+CR_ACCESSORS(cr0)
+CR_ACCESSORS(cr2)
+CR_ACCESSORS(cr3)
+CR_ACCESSORS(cr4)
+
+/** Flush the TLB entry for one page (i486 and up) */
+static inline void invlpg(const void *addr)
+{
+    asm volatile("invlpg	(%0)" : : "r"(addr) : "memory");
+}
+
+///@}
+
 #endif /* CPU_X86_H */
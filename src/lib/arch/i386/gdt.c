@@ -0,0 +1,64 @@
+#include "gdt.h"
+
+#include <core/compiler.h>
+
+#include <stdint.h>
+
+/** GDT segment descriptor */
+struct gdt_desc {
+    uint16_t limit_lo; ///< Segment limit, bits 0-15
+    uint16_t base_lo;  ///< Base address, bits 0-15
+    uint8_t  base_mid; ///< Base address, bits 16-23
+    uint8_t  access;   ///< Type, privilege level, present flag
+    uint8_t  flags;    ///< Limit bits 16-19, and granularity/size flags
+    uint8_t  base_hi;  ///< Base address, bits 24-31
+} ATTR_PACKED;
+
+/** Operand for the LGDT instruction */
+struct gdt_ptr {
+    uint16_t limit;
+    uint32_t base;
+} ATTR_PACKED;
+
+#define SEG_CODE  0x9a ///< Present, ring 0, code, readable
+#define SEG_DATA  0x92 ///< Present, ring 0, data, writable
+#define SEG_FLAT4 0xcf ///< 4 KiB granularity, 32-bit, limit bits 16-19 set
+
+/** Segment from 0 to 4 GiB */
+#define SEG_FLAT(ACCESS) \
+    { \
+        .limit_lo = 0xffff, .access = (ACCESS), .flags = SEG_FLAT4, \
+    }
+
+static struct gdt_desc gdt[] ATTR_ALIGNED(8) = {
+        {0}, // Null descriptor
+        [KERNEL_CS / sizeof(struct gdt_desc)] = SEG_FLAT(SEG_CODE),
+        [KERNEL_DS / sizeof(struct gdt_desc)] = SEG_FLAT(SEG_DATA),
+};
+
+/**
+ * Load the kernel's GDT and reload all segment registers from it.
+ *
+ * Must run before any segment register is loaded, which includes taking an
+ * interrupt or exception.
+ */
+int init_gdt(void)
+{
+    struct gdt_ptr ptr = {.limit = sizeof(gdt) - 1, .base = (uintptr_t) gdt};
+    asm volatile("lgdt	%0" : : "m"(ptr));
+
+    /* Data segments can be loaded directly. CS needs a far jump. */
+    asm volatile(
+            "mov	%w[ds],	%%ds\n"
+            "mov	%w[ds],	%%es\n"
+            "mov	%w[ds],	%%fs\n"
+            "mov	%w[ds],	%%gs\n"
+            "mov	%w[ds],	%%ss\n"
+            "ljmp	%[cs],	$1f\n"
+            "1:\n"
+            :
+            : [ds] "r"(KERNEL_DS), [cs] "i"(KERNEL_CS)
+            : "memory"
+    );
+    return 0;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * Global Descriptor Table
+ *
+ * The bootloader leaves its own GDT loaded, and Multiboot2 does not promise
+ * that it stays valid. So the kernel loads a GDT of its own, with flat 4 GiB
+ * code and data segments, before anything reloads a segment register (e.g.
+ * an interrupt gate, which loads CS).
+ */
+#ifndef ARCH_GDT_H
+#define ARCH_GDT_H
+
+/** @name Segment selectors */
+///@{
+#define KERNEL_CS 0x08 ///< Kernel code segment (GDT entry 1, ring 0)
+#define KERNEL_DS 0x10 ///< Kernel data segment (GDT entry 2, ring 0)
+///@}
+
+int init_gdt(void);
+
+#endif /* ARCH_GDT_H */
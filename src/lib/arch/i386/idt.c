@@ -0,0 +1,111 @@
+#include "idt.h"
+
+#include "cpu.h"
+#include "gdt.h"
+
+#include <drivers/log.h>
+
+#include <core/compiler.h>
+#include <core/macros.h>
+
+#include <stdint.h>
+#include <stdnoreturn.h>
+
+/** IDT gate descriptor */
+struct idt_gate {
+    uint16_t offset_lo; ///< Handler address, bits 0-15
+    uint16_t selector;  ///< Code segment selector
+    uint8_t  zero;
+    uint8_t  type_attr; ///< Gate type, privilege level, present flag
+    uint16_t offset_hi; ///< Handler address, bits 16-31
+} ATTR_PACKED;
+
+/** Operand for the LIDT instruction */
+struct idt_ptr {
+    uint16_t limit;
+    uint32_t base;
+} ATTR_PACKED;
+
+#define GATE_INTR32 0x8e ///< Present, ring 0, 32-bit interrupt gate
+
+static struct idt_gate idt[IDT_ENTRIES] ATTR_ALIGNED(8);
+
+/** Log a CPU exception that we cannot recover from, and stop */
+ATTR_CALLED_FROM_ISR noreturn void exception_fatal(
+        unsigned vector, const struct interrupt_frame *frame, ureg_t err
+)
+{
+    pr_error(
+            "unhandled CPU exception %u at ip " FMT_REG ", error code %#" PRIxREG
+            "; halting\n",
+            vector, frame->ip, err
+    );
+    for (;;) cpu_halt();
+}
+
+/** @name Default exception handlers */
+///@{
+
+#define EXC_NOERR(N) \
+    INTERRUPT_HANDLER static void exc_##N(struct interrupt_frame *frame) \
+    { \
+        exception_fatal(N, frame, 0); \
+    }
+
+#define EXC_ERR(N) \
+    INTERRUPT_HANDLER static void exc_##N( \
+            struct interrupt_frame *frame, ureg_t err \
+    ) \
+    { \
+        exception_fatal(N, frame, err); \
+    }
+
+// clang-format off
+EXC_NOERR(0)  EXC_NOERR(1)  EXC_NOERR(2)  EXC_NOERR(3)
+EXC_NOERR(4)  EXC_NOERR(5)  EXC_NOERR(6)  EXC_NOERR(7)
+EXC_ERR(8)    EXC_NOERR(9)  EXC_ERR(10)   EXC_ERR(11)
+EXC_ERR(12)   EXC_ERR(13)   EXC_ERR(14)   EXC_NOERR(16)
+EXC_ERR(17)   EXC_NOERR(18) EXC_NOERR(19) EXC_NOERR(20)
+
+static void *const EXC_HANDLERS[] = {
+    exc_0,  exc_1,  exc_2,  exc_3,  exc_4,  exc_5,  exc_6,  exc_7,
+    exc_8,  exc_9,  exc_10, exc_11, exc_12, exc_13, exc_14, NULL,
+    exc_16, exc_17, exc_18, exc_19, exc_20,
+};
+// clang-format on
+
+///@}
+
+/**
+ * Point an interrupt vector at a handler.
+ *
+ * The handler should be an @ref INTERRUPT_HANDLER function.
+ */
+void idt_set_handler(unsigned vector, void *isr)
+{
+    if (vector >= IDT_ENTRIES) return;
+
+    uintptr_t addr = (uintptr_t) isr;
+    idt[vector]    = (struct idt_gate){
+               .offset_lo = addr & 0xffff,
+               .selector  = KERNEL_CS,
+               .type_attr = GATE_INTR32,
+               .offset_hi = addr >> 16,
+    };
+}
+
+/**
+ * Load the IDT, with handlers for CPU exceptions.
+ *
+ * Until now, any exception would reset the machine. Now it gets logged.
+ * Interrupts stay disabled.
+ */
+int init_idt(void)
+{
+    for (unsigned i = 0; i < ARRAY_SIZE(EXC_HANDLERS); i++)
+        if (EXC_HANDLERS[i]) idt_set_handler(i, EXC_HANDLERS[i]);
+
+    struct idt_ptr ptr = {.limit = sizeof(idt) - 1, .base = (uintptr_t) idt};
+    asm volatile("lidt	%0" : : "m"(ptr));
+    return 0;
+}
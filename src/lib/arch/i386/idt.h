@@ -0,0 +1,35 @@
+/**
+ * @file
+ * Interrupt Descriptor Table and CPU exceptions
+ */
+#ifndef ARCH_IDT_H
+#define ARCH_IDT_H
+
+#include "cpu.h"
+
+#include <core/compiler.h>
+
+#include <stdnoreturn.h>
+
+#define IDT_ENTRIES 256 ///< Number of interrupt vectors
+
+/** @name CPU exception vectors that we handle specially */
+///@{
+#define VEC_PAGE_FAULT 14 ///< #PF: Page fault
+///@}
+
+/** Stack frame pushed by the CPU on an interrupt with no privilege change */
+struct interrupt_frame {
+    ureg_t ip;    ///< Instruction pointer of interrupted code
+    ureg_t cs;    ///< Code segment of interrupted code
+    ureg_t flags; ///< EFLAGS of interrupted code
+};
+
+int  init_idt(void);
+void idt_set_handler(unsigned vector, void *isr);
+
+ATTR_CALLED_FROM_ISR noreturn void exception_fatal(
+        unsigned vector, const struct interrupt_frame *frame, ureg_t err
+);
+
+#endif /* ARCH_IDT_H */
@@ -0,0 +1,228 @@
+#include "paging.h"
+
+#include "cpu.h"
+#include "idt.h"
+
+#include <drivers/log.h>
+
+#include <core/compiler.h>
+#include <core/errno.h>
+#include <core/macros.h>
+#include <core/page.h>
+#include <core/string.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+pde_t *kernel_pgdir;
+
+static pde_t      *current_pgdir; ///< Loaded page directory (NULL: paging off)
+static pgfault_fn *fault_handler; ///< Resolves not-present user pages
+
+static inline unsigned pde_index(uintptr_t va) { return va >> PGDIR_SHIFT; }
+
+static inline unsigned pte_index(uintptr_t va)
+{
+    return (va >> PAGE_SHIFT) & (PG_ENTRIES - 1);
+}
+
+static pte_t *table_alloc(void)
+{
+    pte_t *pt = page_alloc(0);
+    if (pt) memset(pt, 0, PAGE_SIZE);
+    return pt;
+}
+
+/**
+ * Page fault ISR
+ *
+ * Faults in the user half are passed to the registered handler, which can
+ * map the page and let the access be retried. Anything else is fatal.
+ */
+INTERRUPT_HANDLER static void isr_page_fault(
+        struct interrupt_frame *frame, ureg_t err
+)
+{
+    uintptr_t addr = read_cr2();
+    if (addr >= USER_BASE && fault_handler && fault_handler(addr, err) == 0)
+        return;
+    pr_error("page fault at %#zx (%s%s)\n", addr,
+             err & PFERR_PRESENT ? "protection, " : "not present, ",
+             err & PFERR_WRITE ? "write" : "read");
+    exception_fatal(VEC_PAGE_FAULT, frame, err);
+}
+
+/**
+ * Build the kernel page directory and turn on paging.
+ *
+ * Physical memory from 0 up to phys_end (rounded up to 4 MiB, and capped at
+ * @ref KERNEL_SPLIT) is identity-mapped, so that pointers stay valid. Uses
+ * 4 MiB global pages where the CPU allows it, and 4 KiB pages otherwise.
+ */
+int init_paging(uintptr_t phys_end)
+{
+    uint32_t a, b, c, d = 0;
+    if (cpu_has_cpuid()) cpuid(1, &a, &b, &c, &d);
+    bool     pse    = d & CPUID1_D_PSE;
+    unsigned global = d & CPUID1_D_PGE ? PG_G : 0;
+
+    if (!phys_end) return -EINVAL;
+    kernel_pgdir = table_alloc();
+    if (!kernel_pgdir) return -ENOMEM;
+
+    phys_end = MIN(ALIGN_UP(phys_end, PGDIR_SPAN), KERNEL_SPLIT);
+    for (uintptr_t pa = 0; pa < phys_end; pa += PGDIR_SPAN) {
+        if (pse) {
+            kernel_pgdir[pde_index(pa)] = pa | PG_PS | global | PG_RW | PG_P;
+            continue;
+        }
+        pte_t *pt = table_alloc();
+        if (!pt) return -ENOMEM;
+        for (unsigned i = 0; i < PG_ENTRIES; i++)
+            pt[i] = (pa + i * PAGE_SIZE) | global | PG_RW | PG_P;
+        kernel_pgdir[pde_index(pa)] = (uintptr_t) pt | PG_RW | PG_P;
+    }
+
+    /* PSE must be on before the first 4 MiB entry is used. Global pages are
+     * turned on last, once the kernel mappings are live. */
+    idt_set_handler(VEC_PAGE_FAULT, isr_page_fault);
+    if (pse) write_cr4(read_cr4() | CR4_PSE);
+    write_cr3((uintptr_t) kernel_pgdir);
+    write_cr0(read_cr0() | CR0_PG | CR0_WP);
+    if (global) write_cr4(read_cr4() | CR4_PGE);
+    current_pgdir = kernel_pgdir;
+
+    pr_info("paging on: %#zx bytes mapped with %s%s pages\n", phys_end,
+            pse ? "4 MiB" : "4 KiB", global ? " global" : "");
+    return 0;
+}
+
+/**
+ * Create a page directory for a new address space.
+ *
+ * The kernel half is shared with @ref kernel_pgdir, and the user half
+ * starts out empty.
+ *
+ * @returns the new page directory, or NULL if out of memory
+ */
+pde_t *pgdir_create(void)
+{
+    if (!kernel_pgdir) return NULL;
+    pde_t *pgdir = table_alloc();
+    if (!pgdir) return NULL;
+    memcpy(pgdir, kernel_pgdir, KERNEL_PDES * sizeof(pde_t));
+    return pgdir;
+}
+
+/**
+ * Free a page directory, its user-half page tables, and owned frames.
+ */
+void pgdir_destroy(pde_t *pgdir)
+{
+    if (!pgdir) return;
+    if (pgdir == current_pgdir) pgdir_switch(kernel_pgdir);
+
+    for (unsigned i = KERNEL_PDES; i < PG_ENTRIES; i++) {
+        if (!(pgdir[i] & PG_P)) continue;
+        pte_t *pt = (pte_t *) (pgdir[i] & PG_FRAME);
+        for (unsigned j = 0; j < PG_ENTRIES; j++)
+            if ((pt[j] & (PG_P | PG_OWNED)) == (PG_P | PG_OWNED))
+                page_free((void *) (pt[j] & PG_FRAME));
+        page_free(pt);
+    }
+    page_free(pgdir);
+}
+
+/**
+ * Find the page table entry for a user-half address.
+ *
+ * @param   pgdir   Page directory
+ * @param   vaddr   Virtual address
+ * @param   create  Allocate a page table if there is none
+ * @returns pointer to the entry, or NULL if the address is in the kernel
+ *          half, or there is no page table (and create is false or it could
+ *          not be allocated)
+ */
+pte_t *pgdir_walk(pde_t *pgdir, uintptr_t vaddr, bool create)
+{
+    if (vaddr < USER_BASE) return NULL;
+
+    pde_t *pde = &pgdir[pde_index(vaddr)];
+    if (!(*pde & PG_P)) {
+        if (!create) return NULL;
+        pte_t *pt = table_alloc();
+        if (!pt) return NULL;
+        *pde = (uintptr_t) pt | PG_U | PG_RW | PG_P;
+    }
+    pte_t *pt = (pte_t *) (*pde & PG_FRAME);
+    return &pt[pte_index(vaddr)];
+}
+
+/**
+ * Map one 4 KiB page in the user half.
+ *
+ * @param   pgdir   Page directory
+ * @param   va      Virtual address (page-aligned)
+ * @param   pa      Physical address (page-aligned)
+ * @param   flags   Entry flags, e.g. PG_RW, PG_U, PG_OWNED
+ * @returns 0 on success, or
+ *          - -EINVAL if va is not a page-aligned user-half address
+ *          - -EEXIST if va is already mapped
+ *          - -ENOMEM if a page table could not be allocated
+ */
+int pgdir_map(pde_t *pgdir, uintptr_t va, uintptr_t pa, unsigned flags)
+{
+    if (va < USER_BASE || !IS_ALIGNED(va, PAGE_SIZE)) return -EINVAL;
+
+    pte_t *pte = pgdir_walk(pgdir, va, true);
+    if (!pte) return -ENOMEM;
+    if (*pte & PG_P) return -EEXIST;
+
+    /* Not-present entries are never cached, so no TLB flush needed. */
+    *pte = (pa & PG_FRAME) | (flags & ~PG_FRAME) | PG_P;
+    return 0;
+}
+
+/**
+ * Unmap one 4 KiB page in the user half, freeing the frame if it is owned.
+ */
+int pgdir_unmap(pde_t *pgdir, uintptr_t va)
+{
+    pte_t *pte = pgdir_walk(pgdir, va, false);
+    if (!pte || !(*pte & PG_P)) return -ENOENT;
+
+    if (*pte & PG_OWNED) page_free((void *) (*pte & PG_FRAME));
+    *pte = 0;
+    if (pgdir == current_pgdir) invlpg((void *) va);
+    return 0;
+}
+
+/**
+ * Switch to another address space.
+ *
+ * This is the whole cost of a switch: there is only one CPU, so no other
+ * TLBs to shoot down, and the kernel half is global, so reloading CR3 only
+ * drops the outgoing user-half entries. Switching to the directory that is
+ * already loaded does nothing at all.
+ *
+ * @param   pgdir   Page directory, or NULL for the kernel's own
+ */
+void pgdir_switch(pde_t *pgdir)
+{
+    if (!current_pgdir) return; // Paging is off.
+    if (!pgdir) pgdir = kernel_pgdir;
+    if (pgdir == current_pgdir) return;
+    current_pgdir = pgdir;
+    write_cr3((uintptr_t) pgdir);
+}
+
+/** Get the page directory that is currently loaded (NULL if paging is off) */
+pde_t *pgdir_current(void) { return current_pgdir; }
+
+/**
+ * Set the function that resolves page faults in the user half.
+ *
+ * Used for demand paging: user pages can be left unmapped until first
+ * touched. The handler runs in interrupt context, with interrupts off.
+ */
+void paging_set_fault_handler(pgfault_fn *fn) { fault_handler = fn; }
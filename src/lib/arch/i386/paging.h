@@ -0,0 +1,85 @@
+/**
+ * @file
+ * x86 paging and address spaces
+ *
+ * The 4 GiB virtual address space is split in two:
+ *
+ * - Below @ref KERNEL_SPLIT is the kernel half. Physical memory is
+ *   identity-mapped here, with 4 MiB pages if the CPU has PSE. The mappings
+ *   are global if the CPU has PGE, so they stay in the TLB across address
+ *   space switches. Every page directory shares these entries.
+ *
+ * - From @ref USER_BASE up is the user half, mapped separately for each
+ *   process with 4 KiB pages.
+ *
+ * The kernel half is set up once by @ref init_paging and never changes, so
+ * page directories can copy its entries when they are created.
+ */
+#ifndef ARCH_PAGING_H
+#define ARCH_PAGING_H
+
+#include <core/compiler.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define KERNEL_SPLIT 0x40000000u  ///< End of kernel half (1 GiB)
+#define USER_BASE    KERNEL_SPLIT ///< Start of user half
+
+typedef uint32_t pde_t; ///< Page directory entry
+typedef uint32_t pte_t; ///< Page table entry
+
+/** @name Page directory and table entry flags */
+///@{
+#define PG_P     (1u << 0)   ///< Present
+#define PG_RW    (1u << 1)   ///< Writable
+#define PG_U     (1u << 2)   ///< User-accessible
+#define PG_A     (1u << 5)   ///< Accessed (set by CPU)
+#define PG_D     (1u << 6)   ///< Dirty (set by CPU)
+#define PG_PS    (1u << 7)   ///< PDE: 4 MiB page
+#define PG_G     (1u << 8)   ///< Global: not flushed on CR3 reload
+#define PG_OWNED (1u << 9)   ///< Frame is owned by mapping, free on unmap
+#define PG_FRAME 0xfffff000u ///< Mask: frame address
+///@}
+
+#define PGDIR_SHIFT 22                  ///< log2 of memory per PDE
+#define PGDIR_SPAN  (1u << PGDIR_SHIFT) ///< Memory per PDE (4 MiB)
+#define PG_ENTRIES  1024                ///< Entries per directory or table
+#define KERNEL_PDES (KERNEL_SPLIT >> PGDIR_SHIFT) ///< PDEs in kernel half
+
+/** @name Page fault error code bits */
+///@{
+#define PFERR_PRESENT (1u << 0) ///< Page was present (protection violation)
+#define PFERR_WRITE   (1u << 1) ///< Fault was a write
+#define PFERR_USER    (1u << 2) ///< Fault was in ring 3
+///@}
+
+/**
+ * Page fault handler
+ *
+ * Called from the page fault ISR, so implementations must be marked
+ * @ref ATTR_CALLED_FROM_ISR as well.
+ *
+ * @param   addr    Faulting address (from CR2)
+ * @param   err     Error code, see @ref PFERR_PRESENT and friends
+ * @returns 0 if the fault was resolved and the access can be retried,
+ *          or a negative error code if it was not
+ */
+typedef ATTR_CALLED_FROM_ISR int pgfault_fn(uintptr_t addr, unsigned err);
+
+extern pde_t *kernel_pgdir;
+
+int init_paging(uintptr_t phys_end);
+
+pde_t *pgdir_create(void);
+void   pgdir_destroy(pde_t *pgdir);
+pte_t *pgdir_walk(pde_t *pgdir, uintptr_t vaddr, bool create);
+int    pgdir_map(pde_t *pgdir, uintptr_t va, uintptr_t pa, unsigned flags);
+int    pgdir_unmap(pde_t *pgdir, uintptr_t vaddr);
+void   pgdir_switch(pde_t *pgdir);
+pde_t *pgdir_current(void);
+
+void paging_set_fault_handler(pgfault_fn *fn);
+
+#endif /* ARCH_PAGING_H */
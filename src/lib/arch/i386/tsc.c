@@ -0,0 +1,99 @@
+#include "tsc.h"
+
+#include "cpu.h"
+
+#include <drivers/log.h>
+
+#include <core/clock.h>
+#include <core/errno.h>
+
+#include <stdint.h>
+
+/** @name PIT (Programmable Interval Timer) channel 2, used for calibration */
+///@{
+#define PIT_HZ       1193182 ///< PIT input clock frequency
+#define PIT_CH2      0x42    ///< Channel 2 data port
+#define PIT_CMD      0x43    ///< Mode/command port
+#define PIT_CH2_MODE 0xb0    ///< Channel 2, lo/hi byte, mode 0, binary
+#define PORT_B       0x61    ///< Keyboard controller port B: gate/speaker
+#define PORT_B_GATE2 0x01    ///< Port B: PIT channel 2 gate
+#define PORT_B_SPKR  0x02    ///< Port B: speaker enable
+#define PORT_B_OUT2  0x20    ///< Port B: PIT channel 2 output
+///@}
+
+#define CALIBRATE_LATCH (PIT_HZ / 100) ///< PIT count for one run (~10 ms)
+#define CALIBRATE_RUNS  3              ///< Number of runs (keep the shortest)
+#define CALIBRATE_POLLS 1000000        ///< Give up after this many port reads
+#define TSC_DEFAULT_HZ  1000000000ull  ///< Guess if calibration fails (1 GHz)
+
+static uint64_t tsc_read(void) { return rdtsc(); }
+
+static struct clock_source tsc_clock = {
+        .name = "tsc",
+        .read = tsc_read,
+};
+
+/**
+ * Count TSC ticks while PIT channel 2 counts down from `latch`
+ *
+ * Channel 2's gate and output are wired to port B, so it can be polled
+ * without interrupts. In mode 0, the output goes high when the count
+ * reaches zero. A port read takes about a microsecond, so a few thousand
+ * polls should do. If the output never goes high (e.g. the gate is not
+ * wired on this machine), give up after @ref CALIBRATE_POLLS.
+ *
+ * @returns number of TSC ticks, or 0 on timeout
+ */
+static uint64_t tsc_ticks_per_pit_count(unsigned latch)
+{
+    /* Gate on, speaker off, then load the count. */
+    outb((inb(PORT_B) & ~PORT_B_SPKR) | PORT_B_GATE2, PORT_B);
+    outb(PIT_CH2_MODE, PIT_CMD);
+    outb(latch & 0xff, PIT_CH2);
+    outb(latch >> 8, PIT_CH2);
+
+    uint64_t t0    = rdtsc();
+    unsigned polls = 0;
+    while (!(inb(PORT_B) & PORT_B_OUT2) && ++polls < CALIBRATE_POLLS);
+    uint64_t t1 = rdtsc();
+
+    outb(inb(PORT_B) & ~PORT_B_GATE2, PORT_B);
+    return polls < CALIBRATE_POLLS ? t1 - t0 : 0;
+}
+
+/**
+ * Calibrate the TSC against the PIT and register it as the clock source
+ */
+int init_clock_tsc(void)
+{
+    int res;
+
+    /* The TSC came with the Pentium; we may be running on an i486. */
+    uint32_t a, b, c, d = 0;
+    if (cpu_has_cpuid()) cpuid(1, &a, &b, &c, &d);
+    res = d & CPUID1_D_TSC ? 0 : -ENOTSUP;
+    log_result(res, "check for time stamp counter\n");
+    if (res < 0) return res;
+
+    /* Interrupts or emulator hiccups can only make a run longer,
+     * so the shortest run is the most accurate. */
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < CALIBRATE_RUNS; i++) {
+        uint64_t ticks = tsc_ticks_per_pit_count(CALIBRATE_LATCH);
+        if (!ticks) break; // Timed out: PIT channel 2 is not usable.
+        if (ticks < best) best = ticks;
+    }
+    if (best == UINT64_MAX) {
+        pr_warning("PIT channel 2 timed out, assuming TSC is 1 GHz\n");
+        tsc_clock.hz = TSC_DEFAULT_HZ;
+    } else {
+        tsc_clock.hz = best * PIT_HZ / CALIBRATE_LATCH;
+    }
+
+    res = clock_register(&tsc_clock);
+    log_result(
+            res, "calibrated TSC clock at %lu kHz\n",
+            (unsigned long) (tsc_clock.hz / 1000)
+    );
+    return res;
+}
@@ -0,0 +1,10 @@
+/**
+ * @file
+ * Time Stamp Counter clock source
+ */
+#ifndef ARCH_TSC_H
+#define ARCH_TSC_H
+
+int init_clock_tsc(void);
+
+#endif /* ARCH_TSC_H */
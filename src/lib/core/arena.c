@@ -0,0 +1,133 @@
+#include "arena.h"
+
+#include <core/errno.h>
+#include <core/macros.h>
+#include <core/page.h>
+#include <core/string.h>
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 8 ///< Alignment of arena allocations
+
+/** Chunk header, at the start of each chunk's pages */
+struct arena_chunk {
+    struct arena_chunk *prev; ///< Previous (older) chunk
+    char               *end;  ///< End of this chunk
+};
+
+static inline char *chunk_start(struct arena_chunk *c)
+{
+    return (char *) c + ALIGN_UP(sizeof(*c), ARENA_ALIGN);
+}
+
+/** Add a chunk with room for at least size bytes */
+static int arena_grow(struct arena *a, size_t size)
+{
+    size_t   need  = ALIGN_UP(sizeof(struct arena_chunk), ARENA_ALIGN) + size;
+    unsigned order = MAX(a->order, page_order(need));
+
+    struct arena_chunk *c = page_alloc(order);
+    if (!c) return -ENOMEM;
+    c->prev  = a->chunk;
+    c->end   = (char *) c + ((size_t) PAGE_SIZE << order);
+    a->chunk = c;
+    a->pos   = chunk_start(c);
+    a->end   = c->end;
+    return 0;
+}
+
+/**
+ * Set up an empty arena.
+ *
+ * No memory is taken until the first allocation.
+ *
+ * @param   a       Arena to set up
+ * @param   order   Minimum chunk size, as a page order (0 for one page)
+ */
+void arena_init(struct arena *a, unsigned order)
+{
+    *a = (struct arena){.order = order};
+}
+
+/** Give all of an arena's memory back to the page allocator */
+void arena_destroy(struct arena *a)
+{
+    while (a->chunk) {
+        struct arena_chunk *c = a->chunk;
+        a->chunk              = c->prev;
+        page_free(c);
+    }
+    arena_init(a, a->order);
+}
+
+/**
+ * Allocate memory from an arena.
+ *
+ * @returns pointer to at least size bytes, or NULL if out of memory
+ */
+void *arena_alloc(struct arena *a, size_t size)
+{
+    size = ALIGN_UP(size, ARENA_ALIGN);
+    if (!a->chunk || size > (size_t) (a->end - a->pos))
+        if (arena_grow(a, size) < 0) return NULL;
+
+    void *p = a->pos;
+    a->pos += size;
+    a->used += size;
+    a->peak = MAX(a->peak, a->used);
+    return p;
+}
+
+/** Allocate zeroed memory from an arena */
+void *arena_zalloc(struct arena *a, size_t size)
+{
+    void *p = arena_alloc(a, size);
+    if (p) memset(p, 0, size);
+    return p;
+}
+
+/** Copy a string into an arena */
+char *arena_strdup(struct arena *a, const char *s)
+{
+    size_t n = strlen(s) + 1;
+    char  *p = arena_alloc(a, n);
+    if (p) memcpy(p, s, n);
+    return p;
+}
+
+/** Save the current position of an arena */
+struct arena_mark arena_mark(struct arena *a)
+{
+    return (struct arena_mark){
+            .chunk = a->chunk,
+            .pos   = a->pos,
+            .used  = a->used,
+    };
+}
+
+/**
+ * Free everything allocated since a mark was taken.
+ *
+ * Chunks added since the mark go back to the page allocator, except that
+ * the arena's first chunk is kept for reuse.
+ */
+void arena_release(struct arena *a, struct arena_mark m)
+{
+    while (a->chunk != m.chunk) {
+        struct arena_chunk *c = a->chunk;
+        if (!c->prev) {
+            /* Mark was taken before the first chunk. Keep it, but empty. */
+            a->pos  = chunk_start(c);
+            a->end  = c->end;
+            a->used = m.used;
+            return;
+        }
+        a->chunk = c->prev;
+        page_free(c);
+    }
+    if (a->chunk) {
+        a->pos = m.pos;
+        a->end = a->chunk->end;
+    }
+    a->used = m.used;
+}
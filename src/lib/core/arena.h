@@ -0,0 +1,52 @@
+/**
+ * @file
+ * Arena (region) allocator
+ *
+ * An arena hands out memory by bumping a pointer through a chunk of pages,
+ * and there is no per-object free. Instead, take a mark, allocate as much
+ * as needed, and release everything allocated since the mark in one go:
+ *
+ * ```c
+ * struct arena_mark m = arena_mark(&a);
+ * char *buf = arena_alloc(&a, len);
+ * ...
+ * arena_release(&a, m);
+ * ```
+ *
+ * When a chunk runs out, a new one is taken from the page allocator.
+ * Releasing only has to give back the chunks that were added after the mark,
+ * so a release that stays inside one chunk is O(1).
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+struct arena_chunk;
+
+/** Arena allocator state */
+struct arena {
+    struct arena_chunk *chunk; ///< Current (newest) chunk
+    char               *pos;   ///< Next free byte in current chunk
+    char               *end;   ///< End of current chunk
+    unsigned            order; ///< Minimum chunk size, as a page order
+    size_t              used;  ///< Bytes currently in use
+    size_t              peak;  ///< Most bytes ever in use at once
+};
+
+/** Saved arena position, for @ref arena_release */
+struct arena_mark {
+    struct arena_chunk *chunk;
+    char               *pos;
+    size_t              used;
+};
+
+void              arena_init(struct arena *a, unsigned order);
+void              arena_destroy(struct arena *a);
+void             *arena_alloc(struct arena *a, size_t size);
+void             *arena_zalloc(struct arena *a, size_t size);
+char             *arena_strdup(struct arena *a, const char *s);
+struct arena_mark arena_mark(struct arena *a);
+void              arena_release(struct arena *a, struct arena_mark m);
+
+#endif /* ARENA_H */
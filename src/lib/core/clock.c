@@ -0,0 +1,45 @@
+#include "clock.h"
+
+#include <core/errno.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+static const struct clock_source *clock_src = NULL;
+static uint64_t                   clock_base = 0; ///< Count at registration
+
+/**
+ * Set the clock source.
+ *
+ * The clock starts counting from zero when the source is registered.
+ */
+int clock_register(const struct clock_source *cs)
+{
+    if (!cs || !cs->read || !cs->hz) return -EINVAL;
+    clock_base = cs->read();
+    clock_src  = cs;
+    return 0;
+}
+
+/** Read the clock, in ticks since the source was registered (or zero) */
+uint64_t clock_read(void)
+{
+    return clock_src ? clock_src->read() - clock_base : 0;
+}
+
+/** Get the clock frequency, in ticks per second (or zero) */
+uint64_t clock_hz(void) { return clock_src ? clock_src->hz : 0; }
+
+/** Convert a tick count to nanoseconds */
+uint64_t clock_ticks_to_ns(uint64_t ticks)
+{
+    if (!clock_src) return 0;
+
+    /* Split into whole seconds and the rest, so that the multiplication
+     * cannot overflow (the rest is less than hz). */
+    uint64_t hz = clock_src->hz;
+    return ticks / hz * NSEC_PER_SEC + ticks % hz * NSEC_PER_SEC / hz;
+}
+
+/** Read the clock, in nanoseconds since the source was registered */
+uint64_t clock_ns(void) { return clock_ticks_to_ns(clock_read()); }
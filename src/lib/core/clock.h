@@ -0,0 +1,38 @@
+/**
+ * @file
+ * Clock source and interval timing
+ *
+ * The clock is a free-running counter with a known frequency, provided by
+ * architecture code (e.g. the x86 TSC). Until a source is registered, the
+ * clock reads as zero.
+ *
+ * To time an interval:
+ *
+ * ```c
+ * uint64_t t0 = clock_read();
+ * do_stuff();
+ * uint64_t ns = clock_ticks_to_ns(clock_read() - t0);
+ * ```
+ */
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+#define NSEC_PER_SEC  1000000000ull ///< Nanoseconds per second
+#define NSEC_PER_USEC 1000ull       ///< Nanoseconds per microsecond
+
+/** Clock source: a free-running counter with a known frequency */
+struct clock_source {
+    const char *name;       ///< Name for log messages
+    uint64_t    hz;         ///< Counter frequency in Hz
+    uint64_t (*read)(void); ///< Read the counter
+};
+
+int      clock_register(const struct clock_source *cs);
+uint64_t clock_read(void);
+uint64_t clock_hz(void);
+uint64_t clock_ticks_to_ns(uint64_t ticks);
+uint64_t clock_ns(void);
+
+#endif /* CLOCK_H */
@@ -97,6 +97,21 @@
  */
 #define ATTR_ALIGNED(ALIGNMENT) __attribute__((aligned(ALIGNMENT)))
 
+/**
+ * Type attr: Accesses through this type may alias any other type
+ *
+ * Normally the compiler assumes that pointers to different types never point
+ * to the same memory (the "strict aliasing" rule). This attribute lifts that
+ * assumption for the given type, the same way `char` is exempt. This is
+ * needed when, for example, a memory routine reads a byte buffer one machine
+ * word at a time.
+ *
+ * @see
+ * [GCC's `may_alias` attribute](
+        https://gcc.gnu.org/onlinedocs/gcc/Common-Type-Attributes.html#index-may_005falias-type-attribute)
+ */
+#define ATTR_MAY_ALIAS __attribute__((may_alias))
+
 ///@}
 
 /** @name Interrupt handlers. */
@@ -102,7 +102,7 @@
 /** @name POSIX: I/O: Filesystem */
 ///@{
 //#define EACCES           28 ///< Permission denied.
-//#define EEXIST           29 ///< File exists.
+#define EEXIST           29 ///< File exists.
 //#define EFBIG            30 ///< File too large.
 #define EISDIR           31 ///< Is a directory.
 //#define ENAMETOOLONG     32 ///< Filename too long.
@@ -179,6 +179,17 @@ static inline void list_del(struct list_head *item)
     item->prev = NULL;
 }
 
+/**
+ * Move item to front of list (after head).
+ *
+ * Removes `item` from whatever list it is in, and adds it after `head`.
+ */
+static inline void list_move(struct list_head *item, struct list_head *head)
+{
+    list_del(item);
+    list_add(item, head);
+}
+
 ///@}
 
 /** @name List entry retrieval */
@@ -413,5 +424,21 @@ static inline void list_rotate_left(struct list_head *head)
          !list_entry_is_head(pos, head, member); \
          pos = n, n = list_next_entry(n, member))
 
+/**
+ * Backwards iteration over a list's entries that tolerates removal of the
+ * current entry
+ *
+ * @param   pos     Cursor pointer, a pointer of the list's entry type.
+ *                  Must be declared elsewhere.
+ * @param   n       A second entry type pointer for temporay storage.
+ * @param   head    Pointer to list head.
+ * @param   member  The name of the list_head field within entry struct type.
+ */
+#define list_for_each_entry_safe_reverse(pos, n, head, member) \
+    for (pos = list_last_entry(head, typeof(*pos), member), \
+        n    = list_prev_entry(pos, member); \
+         !list_entry_is_head(pos, head, member); \
+         pos = n, n = list_prev_entry(n, member))
+
 ///@}
 #endif /* LIST_H */
@@ -0,0 +1,209 @@
+#include "page.h"
+
+#include <core/errno.h>
+#include <core/list.h>
+#include <core/macros.h>
+#include <core/string.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @name Per-page metadata
+ *
+ * One byte per page in the managed span. For the first page of a block, the
+ * low bits hold the block's order. Other pages in a block are PM_TAIL.
+ */
+///@{
+#define PM_ORDER 0x0f ///< Mask: order of block starting at this page
+#define PM_FREE  0x80 ///< Flag: first page of a free block
+#define PM_NONE  0x40 ///< Flag: page is not managed (hole or reserved)
+#define PM_USED  0x20 ///< Flag: first page of an allocated block
+#define PM_TAIL  0x00 ///< Not the first page of a block
+///@}
+
+#define BLOCK_ALIGN ((uintptr_t) PAGE_SIZE << PAGE_MAX_ORDER)
+
+static uintptr_t        page_base;   ///< Address of page 0 in the span
+static size_t           page_count;  ///< Number of pages in the span
+static uint8_t         *page_meta;   ///< Metadata, one byte per page
+static struct list_head free_lists[PAGE_MAX_ORDER + 1];
+static struct page_stats stats;
+
+static inline size_t addr_to_idx(uintptr_t addr)
+{
+    return (addr - page_base) >> PAGE_SHIFT;
+}
+
+static inline void *idx_to_ptr(size_t idx)
+{
+    return (void *) (page_base + (idx << PAGE_SHIFT));
+}
+
+/** Put a block on the free list for its order */
+static void block_push(size_t idx, unsigned order)
+{
+    page_meta[idx] = PM_FREE | order;
+    list_add(idx_to_ptr(idx), &free_lists[order]);
+    stats.blocks[order]++;
+}
+
+/** Take a specific block off the free list for its order */
+static void block_remove(size_t idx, unsigned order)
+{
+    page_meta[idx] = PM_TAIL;
+    list_del(idx_to_ptr(idx));
+    stats.blocks[order]--;
+}
+
+/** Free a block, merging with its buddy for as long as the buddy is free */
+static void block_free(size_t idx, unsigned order)
+{
+    stats.free += (size_t) 1 << order;
+    for (; order < PAGE_MAX_ORDER; order++) {
+        size_t buddy = idx ^ ((size_t) 1 << order);
+        if (buddy >= page_count) break;
+        if (page_meta[buddy] != (PM_FREE | order)) break;
+        block_remove(buddy, order);
+        page_meta[idx] = PM_TAIL;
+        idx &= ~((size_t) 1 << order);
+    }
+    block_push(idx, order);
+}
+
+/**
+ * Set up the allocator to manage addresses from lo to hi.
+ *
+ * The span may contain holes. Only memory given with @ref page_add_range will
+ * be handed out. Metadata (one byte per page) is taken from the first range
+ * that is added.
+ */
+int page_init(uintptr_t lo, uintptr_t hi)
+{
+    if (hi <= lo) return -EINVAL;
+    page_base  = ALIGN_DOWN(lo, BLOCK_ALIGN);
+    page_count = (ALIGN_DOWN(hi, PAGE_SIZE) - page_base) >> PAGE_SHIFT;
+    page_meta  = NULL;
+    stats      = (struct page_stats){0};
+    for (unsigned i = 0; i <= PAGE_MAX_ORDER; i++)
+        INIT_LIST_HEAD(&free_lists[i]);
+    return 0;
+}
+
+/**
+ * Give a range of free memory to the allocator.
+ *
+ * The range is shrunk to whole pages within the span given to
+ * @ref page_init. Ranges must not overlap.
+ */
+int page_add_range(uintptr_t start, uintptr_t end)
+{
+    if (!page_count) return -EINVAL;
+
+    /* Clamp to span and page boundaries. */
+    uintptr_t span_end = page_base + (page_count << PAGE_SHIFT);
+    start              = ALIGN_UP(MAX(start, page_base), PAGE_SIZE);
+    end                = ALIGN_DOWN(MIN(end, span_end), PAGE_SIZE);
+    if (end <= start) return 0;
+
+    /* Carve metadata from the first range, and mark all pages unmanaged. */
+    if (!page_meta) {
+        size_t metasz = ALIGN_UP(page_count, PAGE_SIZE);
+        if (end - start <= metasz) return -ENOMEM;
+        page_meta = (uint8_t *) start;
+        memset(page_meta, PM_NONE, page_count);
+        start += metasz;
+    }
+
+    /* Free the range as the largest aligned blocks that fit. */
+    size_t idx = addr_to_idx(start), endidx = addr_to_idx(end);
+    stats.total += endidx - idx;
+    while (idx < endidx) {
+        unsigned order = 0;
+        while (order < PAGE_MAX_ORDER
+               && IS_ALIGNED(idx, (size_t) 2 << order)
+               && idx + ((size_t) 2 << order) <= endidx)
+            order++;
+        block_free(idx, order);
+        idx += (size_t) 1 << order;
+    }
+    return 0;
+}
+
+/**
+ * Allocate a block of 2^order contiguous pages, aligned to its size.
+ *
+ * @returns pointer to the block, or NULL if there is no block that big
+ */
+void *page_alloc(unsigned order)
+{
+    if (order > PAGE_MAX_ORDER) return NULL;
+
+    /* Find the smallest free block that is big enough. */
+    unsigned have = order;
+    while (have <= PAGE_MAX_ORDER && list_empty(&free_lists[have])) have++;
+    if (have > PAGE_MAX_ORDER) return NULL;
+
+    size_t idx = addr_to_idx((uintptr_t) free_lists[have].next);
+    block_remove(idx, have);
+
+    /* Split it, putting the upper halves back, until it is the right size. */
+    while (have > order) {
+        have--;
+        block_push(idx + ((size_t) 1 << have), have);
+    }
+
+    page_meta[idx] = PM_USED | order;
+    stats.free -= (size_t) 1 << order;
+    return idx_to_ptr(idx);
+}
+
+/**
+ * Free a block from @ref page_alloc.
+ */
+void page_free(void *p)
+{
+    if (!p) return;
+    size_t idx = addr_to_idx((uintptr_t) p);
+    if (idx >= page_count || !(page_meta[idx] & PM_USED)) return;
+    block_free(idx, page_meta[idx] & PM_ORDER);
+}
+
+/**
+ * Find the allocated block that contains an address.
+ *
+ * A block of order n starts at a page index that is a multiple of 2^n, so
+ * there is only one candidate start per order.
+ *
+ * @param   p       Address anywhere inside the block
+ * @param   order   [output] Order of the block (optional)
+ * @returns pointer to the start of the block, or NULL if p is not inside an
+ *          allocated block
+ */
+void *page_block(const void *p, unsigned *order)
+{
+    size_t idx = addr_to_idx((uintptr_t) p);
+    if (!page_meta || (uintptr_t) p < page_base || idx >= page_count)
+        return NULL;
+
+    for (unsigned o = 0; o <= PAGE_MAX_ORDER; o++) {
+        size_t head = idx & ~(((size_t) 1 << o) - 1);
+        if (page_meta[head] == (PM_USED | o)) {
+            if (order) *order = o;
+            return idx_to_ptr(head);
+        }
+    }
+    return NULL;
+}
+
+/** Get the smallest order that holds a given number of bytes */
+unsigned page_order(size_t size)
+{
+    unsigned order = 0;
+    while (((size_t) PAGE_SIZE << order) < size) order++;
+    return order;
+}
+
+/** Get current allocator statistics */
+void page_get_stats(struct page_stats *s) { *s = stats; }
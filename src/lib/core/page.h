@@ -0,0 +1,39 @@
+/**
+ * @file
+ * Page-frame allocator
+ *
+ * A binary buddy allocator for page frames. Memory is handed out in blocks
+ * of 2^order pages, aligned to their own size. Allocation and free are
+ * O(log n) in the number of orders: a block is split or merged with its
+ * "buddy" at most once per order.
+ *
+ * Memory must be identity-mapped (or at least directly accessible) because
+ * free blocks store their list links in the free memory itself.
+ */
+#ifndef PAGE_H
+#define PAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PAGE_SHIFT     12                  ///< log2 of page size
+#define PAGE_SIZE      (1ul << PAGE_SHIFT) ///< Page size (4 KiB)
+#define PAGE_MAX_ORDER 10 ///< Largest block is 2^10 pages (4 MiB)
+
+/** Page allocator statistics */
+struct page_stats {
+    size_t total; ///< Pages given to the allocator (not counting metadata)
+    size_t free;  ///< Pages currently free
+    size_t blocks[PAGE_MAX_ORDER + 1]; ///< Free blocks of each order
+};
+
+int  page_init(uintptr_t lo, uintptr_t hi);
+int  page_add_range(uintptr_t start, uintptr_t end);
+void page_get_stats(struct page_stats *stats);
+
+void    *page_alloc(unsigned order);
+void     page_free(void *p);
+void    *page_block(const void *p, unsigned *order);
+unsigned page_order(size_t size);
+
+#endif /* PAGE_H */
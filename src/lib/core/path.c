@@ -51,3 +51,23 @@ int path_basename(char *dst, size_t dstsz, const char *path)
     int nlen = nend - nstart;
     return snprintf(dst, dstsz, "%.*s", nlen, nstart);
 }
+
+/**
+ * Get the next component of a path
+ *
+ * Leading and repeated slashes are skipped, so "/a//b/" has the two
+ * components "a" and "b".
+ *
+ * @param   path    Position in path, advanced past the component
+ * @param   comp    Set to start of component (not null-terminated)
+ * @returns length of component, or 0 at end of path
+ */
+size_t path_next(const char **path, const char **comp)
+{
+    const char *pos = *path;
+    while (*pos == '/') pos++;
+    *comp = pos;
+    while (*pos && *pos != '/') pos++;
+    *path = pos;
+    return pos - *comp;
+}
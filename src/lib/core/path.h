@@ -3,8 +3,9 @@
 
 #include <stddef.h>
 
-int   path_join(char *dst, size_t dstsz, const char *a, const char *b);
-char *path_strip_prefix(const char *path, const char *prefix);
-int   path_basename(char *dst, size_t dstsz, const char *path);
+int    path_join(char *dst, size_t dstsz, const char *a, const char *b);
+char  *path_strip_prefix(const char *path, const char *prefix);
+int    path_basename(char *dst, size_t dstsz, const char *path);
+size_t path_next(const char **path, const char **comp);
 
 #endif /* PATH_H */
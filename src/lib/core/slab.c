@@ -0,0 +1,275 @@
+#include "slab.h"
+
+#include <core/errno.h>
+#include <core/list.h>
+#include <core/macros.h>
+#include <core/page.h>
+#include <core/string.h>
+
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SLAB_MIN_OBJS  8 ///< Grow slab size until it holds this many objects
+#define SLAB_MAX_ORDER 3 ///< ...but not past this order, if one object fits
+
+/** Slab header, at the start of each slab's block of pages */
+struct slab {
+    struct list_head   list;     ///< Entry in cache's partial or full list
+    struct kmem_cache *cache;    ///< Cache that this slab belongs to
+    void              *freelist; ///< First free object
+    unsigned           inuse;    ///< Number of allocated objects
+};
+
+struct list_head kmem_cache_list = LIST_HEAD_INIT(kmem_cache_list);
+
+static inline size_t slab_bytes(struct kmem_cache *c)
+{
+    return (size_t) PAGE_SIZE << c->order;
+}
+
+static inline size_t slab_first(struct kmem_cache *c)
+{
+    return ALIGN_UP(sizeof(struct slab), c->align);
+}
+
+/** Get the slab that an object belongs to (slabs are size-aligned) */
+static inline struct slab *slab_of(struct kmem_cache *c, void *obj)
+{
+    return (struct slab *) ALIGN_DOWN((uintptr_t) obj, slab_bytes(c));
+}
+
+/**
+ * Get the freelist link for a free object
+ *
+ * If the cache has a constructor, the link goes after the object so that it
+ * does not clobber constructed state. Otherwise it reuses the object's
+ * first word.
+ */
+static inline void **obj_link(struct kmem_cache *c, void *obj)
+{
+    size_t off = c->ctor ? ALIGN_UP(c->size, alignof(void *)) : 0;
+    return (void **) ((char *) obj + off);
+}
+
+/** Work out the slab layout for a cache, on first use */
+static void cache_setup(struct kmem_cache *c)
+{
+    c->align = MAX(c->align, alignof(void *));
+
+    size_t linkend = sizeof(void *);
+    if (c->ctor) linkend += ALIGN_UP(c->size, alignof(void *));
+    c->objsize = ALIGN_UP(MAX(c->size, linkend), c->align);
+
+    for (c->order = 0; c->order < PAGE_MAX_ORDER; c->order++) {
+        size_t n = (slab_bytes(c) - slab_first(c)) / c->objsize;
+        if (n >= SLAB_MIN_OBJS || (n && c->order >= SLAB_MAX_ORDER)) break;
+    }
+    c->perslab = (slab_bytes(c) - slab_first(c)) / c->objsize;
+
+    list_add_tail(&c->caches, &kmem_cache_list);
+}
+
+/** Add a new slab to the cache */
+static int cache_grow(struct kmem_cache *c)
+{
+    struct slab *s = page_alloc(c->order);
+    if (!s) return -ENOMEM;
+    *s = (struct slab){.cache = c};
+
+    /* Construct objects and thread them onto the freelist, in order. */
+    char *obj = (char *) s + slab_first(c);
+    for (unsigned i = 0; i < c->perslab; i++, obj += c->objsize) {
+        if (c->ctor) c->ctor(obj);
+        else if (SLAB_DEBUG) memset(obj, POISON_FREE, c->objsize);
+        *obj_link(c, obj) = i + 1 < c->perslab ? obj + c->objsize : NULL;
+    }
+    s->freelist = (char *) s + slab_first(c);
+
+    list_add(&s->list, &c->partial);
+    c->stats.slabs++;
+    c->stats.total += c->perslab;
+    return 0;
+}
+
+/**
+ * Allocate an object from a cache.
+ *
+ * @returns pointer to the object, or NULL if out of memory
+ */
+void *kmem_cache_alloc(struct kmem_cache *c)
+{
+    if (!c->perslab) cache_setup(c);
+
+    if (!list_empty(&c->partial)) c->stats.hits++;
+    else if (cache_grow(c) < 0) return NULL;
+
+    struct slab *s   = list_first_entry(&c->partial, struct slab, list);
+    void        *obj = s->freelist;
+    s->freelist      = *obj_link(c, obj);
+
+    /* Move slab to full list when it has no more free objects. */
+    if (++s->inuse == c->perslab) {
+        list_del(&s->list);
+        list_add(&s->list, &c->full);
+    }
+
+    c->stats.allocs++;
+    c->stats.active++;
+    return obj;
+}
+
+/**
+ * Return an object to its cache.
+ *
+ * Empty slabs go back to the page allocator, except that the cache keeps up
+ * to one slab's worth of free objects to avoid thrashing.
+ */
+void kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+    if (!obj) return;
+    struct slab *s = slab_of(c, obj);
+
+    /* A full slab is about to have a free object. */
+    if (s->inuse == c->perslab) {
+        list_del(&s->list);
+        list_add(&s->list, &c->partial);
+    }
+
+    *obj_link(c, obj) = s->freelist;
+    s->freelist       = obj;
+    s->inuse--;
+    c->stats.frees++;
+    c->stats.active--;
+
+    if (!s->inuse && c->stats.total - c->stats.active > c->perslab) {
+        list_del(&s->list);
+        page_free(s);
+        c->stats.slabs--;
+        c->stats.total -= c->perslab;
+    }
+}
+
+/** @name Kernel heap */
+///@{
+
+#define KMALLOC_ALIGN 8 ///< Alignment of heap allocations
+
+#define KMALLOC_CACHE(SHIFT, SIZE) \
+    KMEM_CACHE_INIT( \
+            kmalloc_caches[SHIFT - KMALLOC_MIN_SHIFT], "kmalloc-" #SIZE, \
+            SIZE, KMALLOC_ALIGN, NULL \
+    )
+
+/** General-purpose caches, one per power-of-two size class */
+static struct kmem_cache kmalloc_caches[] = {
+        KMALLOC_CACHE(4, 16),    KMALLOC_CACHE(5, 32),
+        KMALLOC_CACHE(6, 64),    KMALLOC_CACHE(7, 128),
+        KMALLOC_CACHE(8, 256),   KMALLOC_CACHE(9, 512),
+        KMALLOC_CACHE(10, 1024), KMALLOC_CACHE(11, 2048),
+};
+
+static struct kmalloc_stats kstats;
+
+static unsigned size_shift(size_t size)
+{
+    unsigned shift = KMALLOC_MIN_SHIFT;
+    while (((size_t) 1 << shift) < size) shift++;
+    return shift;
+}
+
+/** Check that a freed object still holds the free poison (debug) */
+static void poison_check(const void *p, size_t n)
+{
+    const unsigned char *b = p;
+    for (size_t i = sizeof(void *); i < n; i++) {
+        if (b[i] != POISON_FREE) {
+            kstats.poison_errors++;
+            return;
+        }
+    }
+}
+
+/**
+ * Allocate memory from the kernel heap.
+ *
+ * Sizes up to @ref KMALLOC_MAX_CACHED come from power-of-two size-class
+ * caches, bigger sizes come directly from the page allocator.
+ *
+ * @returns pointer to at least size bytes, or NULL if out of memory (or if
+ *          size is 0)
+ */
+void *kmalloc(size_t size)
+{
+    if (!size) return NULL;
+
+    void  *p;
+    size_t got;
+    if (size <= KMALLOC_MAX_CACHED) {
+        unsigned           shift = size_shift(size);
+        struct kmem_cache *c     = &kmalloc_caches[shift - KMALLOC_MIN_SHIFT];
+        p                        = kmem_cache_alloc(c);
+        got                      = c->size;
+        if (SLAB_DEBUG && p) poison_check(p, got);
+    } else {
+        unsigned order = page_order(size);
+        p              = page_alloc(order);
+        got            = (size_t) PAGE_SIZE << order;
+        if (p) kstats.large_pages += (size_t) 1 << order;
+    }
+
+    if (!p) {
+        kstats.failed++;
+        return NULL;
+    }
+    kstats.allocs++;
+    kstats.requested += size;
+    kstats.allocated += got;
+    kstats.live += got;
+    if (SLAB_DEBUG) memset(p, POISON_ALLOC, got);
+    return p;
+}
+
+/** Allocate zeroed memory from the kernel heap */
+void *kzalloc(size_t size)
+{
+    void *p = kmalloc(size);
+    if (p) memset(p, 0, size);
+    return p;
+}
+
+/**
+ * Free memory from @ref kmalloc.
+ *
+ * Large allocations are whole page blocks. Anything else is inside a slab,
+ * whose header says which cache it belongs to.
+ */
+void kfree(void *p)
+{
+    if (!p) return;
+
+    unsigned order;
+    void    *block = page_block(p, &order);
+    if (!block) return;
+
+    size_t size;
+    if (block == p) {
+        size = (size_t) PAGE_SIZE << order;
+        kstats.large_pages -= (size_t) 1 << order;
+        if (SLAB_DEBUG) memset(p, POISON_FREE, size);
+        page_free(p);
+    } else {
+        struct slab *s = block;
+        size           = s->cache->size;
+        if (SLAB_DEBUG) memset(p, POISON_FREE, size);
+        kmem_cache_free(s->cache, p);
+    }
+
+    kstats.frees++;
+    kstats.live -= size;
+}
+
+/** Get kernel heap statistics */
+void kmalloc_get_stats(struct kmalloc_stats *stats) { *stats = kstats; }
+
+///@}
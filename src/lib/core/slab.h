@@ -0,0 +1,128 @@
+/**
+ * @file
+ * Object caches (slab allocator) and kernel heap
+ *
+ * A cache hands out fixed-size objects of one type. Objects are carved from
+ * blocks of pages (slabs) taken from the page allocator, and each slab keeps
+ * a freelist of its unused objects, so allocation and free are O(1).
+ *
+ * If the cache has a constructor, it runs once when a slab is created, not
+ * on every allocation. Objects should be returned to the cache in their
+ * constructed state.
+ *
+ * Caches are defined statically and set themselves up on first use:
+ *
+ * ```c
+ * static KMEM_CACHE(foo_cache, "foo", struct foo, NULL);
+ *
+ * struct foo *f = kmem_cache_alloc(&foo_cache);
+ * kmem_cache_free(&foo_cache, f);
+ * ```
+ *
+ * For variable-sized data, @ref kmalloc rounds the size up to a power of two
+ * and allocates from one of a set of general-purpose caches. Requests bigger
+ * than @ref KMALLOC_MAX_CACHED go straight to the page allocator.
+ */
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <core/list.h>
+
+#include <stdalign.h>
+#include <stddef.h>
+
+typedef void kmem_ctor_fn(void *obj);
+
+/** Object cache statistics */
+struct kmem_cache_stats {
+    size_t allocs; ///< Number of allocations
+    size_t hits;   ///< ...that were served without growing the cache
+    size_t frees;  ///< Number of frees
+    size_t slabs;  ///< Slabs currently held
+    size_t active; ///< Objects currently allocated
+    size_t total;  ///< Objects in all slabs (active + free)
+};
+
+/** Object cache */
+struct kmem_cache {
+    const char   *name;   ///< Name for statistics
+    size_t        size;   ///< Requested object size
+    size_t        align;  ///< Object alignment
+    kmem_ctor_fn *ctor;   ///< Constructor, run when a slab is created
+
+    size_t   objsize;  ///< Object stride within a slab
+    unsigned order;    ///< Slab size is 2^order pages
+    unsigned perslab;  ///< Objects per slab (0 until first use)
+
+    struct list_head partial; ///< Slabs with some free objects
+    struct list_head full;    ///< Slabs with no free objects
+    struct list_head caches;  ///< Entry in @ref kmem_cache_list
+
+    struct kmem_cache_stats stats;
+};
+
+/** Initializer for a cache stored at VAR */
+#define KMEM_CACHE_INIT(VAR, NAME, SIZE, ALIGN, CTOR) \
+    { \
+            .name    = NAME, \
+            .size    = SIZE, \
+            .align   = ALIGN, \
+            .ctor    = CTOR, \
+            .partial = LIST_HEAD_INIT(VAR.partial), \
+            .full    = LIST_HEAD_INIT(VAR.full), \
+            .caches  = LIST_HEAD_INIT(VAR.caches), \
+    }
+
+/** Define a cache for objects of type TYPE */
+#define KMEM_CACHE(VAR, NAME, TYPE, CTOR) \
+    struct kmem_cache VAR = \
+            KMEM_CACHE_INIT(VAR, NAME, sizeof(TYPE), alignof(TYPE), CTOR)
+
+/** List of all caches that have been used, for statistics */
+extern struct list_head kmem_cache_list;
+
+void *kmem_cache_alloc(struct kmem_cache *cache);
+void  kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+/** @name Kernel heap */
+///@{
+
+#define KMALLOC_MIN_SHIFT  4  ///< Smallest size class is 16 bytes
+#define KMALLOC_MAX_SHIFT  11 ///< Largest size class is 2 KiB
+#define KMALLOC_MAX_CACHED (1u << KMALLOC_MAX_SHIFT)
+
+/**
+ * @def SLAB_DEBUG
+ * Poison heap memory to catch use of uninitialized and freed memory
+ *
+ * Fresh allocations are filled with @ref POISON_ALLOC, and freed memory with
+ * @ref POISON_FREE. Freed memory is checked when it is handed out again,
+ * and any change is counted in @ref kmalloc_stats.poison_errors.
+ */
+#ifndef SLAB_DEBUG
+#define SLAB_DEBUG 0
+#endif
+
+#define POISON_ALLOC 0xa5 ///< Fill byte for fresh allocations (debug)
+#define POISON_FREE  0x6b ///< Fill byte for freed memory (debug)
+
+/** Kernel heap statistics */
+struct kmalloc_stats {
+    size_t allocs;        ///< Number of successful allocations
+    size_t frees;         ///< Number of frees
+    size_t failed;        ///< Number of failed allocations
+    size_t requested;     ///< Bytes requested, over all allocations
+    size_t allocated;     ///< Bytes handed out, over all allocations
+    size_t live;          ///< Bytes currently handed out
+    size_t large_pages;   ///< Pages currently used by large allocations
+    size_t poison_errors; ///< Freed objects found modified (debug)
+};
+
+void *kmalloc(size_t size);
+void *kzalloc(size_t size);
+void  kfree(void *p);
+void  kmalloc_get_stats(struct kmalloc_stats *stats);
+
+///@}
+
+#endif /* SLAB_H */
@@ -5,8 +5,8 @@
 #include "sprintf.h"
 
 #include <core/compiler.h>
-#include <core/ctype.h>
 #include <core/errno.h>
+#include <core/macros.h>
 #include <core/math.h>
 #include <core/string.h>
 
@@ -28,14 +28,13 @@
 ///@{
 #define PREFIXBUFSZ 8   ///< Buffer size for number prefixes (sign, "0x", etc.)
 #define FMTCPYSZ    32  ///< Buffer size for debug copy of format pattern
-#define DIGITBUFSZ  128 ///< Buffer size for temporary digit buffers
+#define DIGITBUFSZ  (sizeof(uintmax_t) * CHAR_BIT) ///< Enough for base 2
 ///@}
 
 /** @name Internal implemention flags */
 ///@{
 #define CF_NONE        0x00 ///< No flags
 #define CF_UP          0x01 ///< Use uppercase ("%#X" -> "0X0AF")
-#define CF_OCTALPREFIX 0x02 ///< Add zero for octal prefix ("%#o" -> "0644")
 
 ///@}
 
@@ -59,45 +58,104 @@ struct fmtspec {
 };
 
 /**
- * @name Character and string output
+ * Output state for the formatter
  *
  * The 'snprintf' family writes to a bounded buffer, but they also calculate
  * the number of characters that _would be written_ if the buffer was large
- * enough.
+ * enough. The streaming functions instead write to a small buffer that is
+ * flushed to a sink callback whenever it fills up.
  *
- * To calculate this, every character that would be written is sent through
- * these output functions. The character is only written if the position
- * is in bounds. But the position pointer is advanced either way.
+ * To support both, every character that would be written is sent through
+ * the output functions below. The character is only written if there is
+ * room in the buffer (after flushing, if there is a sink). But the count is
+ * advanced either way.
+ */
+struct fmtout {
+    char             *pos;    ///< Current position in buffer
+    char             *end;    ///< One past end of buffer
+    size_t            count;  ///< Number of chars output, even if not written
+    struct fmtstream *stream; ///< Stream to flush to when full (may be NULL)
+};
+
+/**
+ * Argument source for the formatter
  *
- * In the end, the formatted output is written as far as it will go,
- * and the character count can be found by comparing the ending position
- * to the start of the buffer.
+ * Arguments normally come straight from a va_list. They can also be packed:
+ * recorded as raw values into a buffer by @ref vfmtpack, and read back later
+ * to render the output. Strings are copied into the package, so the package
+ * does not depend on any of the caller's buffers.
+ */
+struct fmtargs {
+    enum {
+        ARGS_VA,     ///< Read args from va_list
+        ARGS_PACK,   ///< Read args from va_list, and record them in package
+        ARGS_UNPACK, ///< Read args from package
+    } mode;
+    va_list *va;  ///< Variadic args (unless unpacking)
+    char    *pkg; ///< Package buffer (unless reading va_list only)
+    size_t   len; ///< Size of package buffer
+    size_t   off; ///< Current offset in package, even if past the end
+};
+
+/**
+ * @name Character and string output
  *
- * @param   s       Pointer to position in buffer
- * @param   t       Pointer to position one past end of buffer
- * @return  Updated s pointer
+ * @param   o       Output state
  */
 ///@{
 
+/** Stream output: Hand buffered output to the sink and reset the buffer */
+static void outdrain(struct fmtout *o)
+{
+    struct fmtstream *fs = o->stream;
+    size_t            n  = o->pos - fs->buf;
+    if (n && !fs->err) {
+        int res = fs->sink(fs->ctx, fs->buf, n);
+        if (res < 0) fs->err = res;
+    }
+    o->pos = fs->buf;
+}
+
 /** Basic output: Output a single character */
-static inline char *outchar(char *s, char *t, int c)
+static inline void outchar(struct fmtout *o, int c)
 {
-    if (s < t) *s = c; // Write to buffer, only if in bounds.
-    return ++s;        // Advance buffer pointer either way.
+    if (o->pos == o->end && o->stream) outdrain(o);
+    if (o->pos < o->end) *o->pos++ = c; // Write to buffer, only if in bounds.
+    o->count++;                         // Count it either way.
+}
+
+/**
+ * Bulk output: Make room for up to `len` chars and return how many fit
+ *
+ * Drains the stream buffer first if it is full. The caller copies the
+ * returned number of chars to `o->pos` and advances it.
+ */
+static inline size_t outroom(struct fmtout *o, size_t len)
+{
+    if (o->pos == o->end && o->stream) outdrain(o);
+    return MIN(len, (size_t) (o->end - o->pos));
 }
 
 /** Basic output: Output padding chars */
-static char *outpad(char *s, char *t, int c, size_t len)
+static void outpad(struct fmtout *o, int c, size_t len)
 {
-    for (; len; len--) s = outchar(s, t, c);
-    return s;
+    o->count += len;
+    for (size_t n; len && (n = outroom(o, len)); len -= n, o->pos += n)
+        memset(o->pos, c, n);
+}
+
+/** Basic output: Output a string of known length */
+static void outmem(struct fmtout *o, const char *str, size_t len)
+{
+    o->count += len;
+    for (size_t n; len && (n = outroom(o, len)); len -= n, o->pos += n)
+        memcpy(o->pos, str, n), str += n;
 }
 
 /** Basic output: Output a string */
-static char *outstr(char *s, char *t, const char *str)
+static void outstr(struct fmtout *o, const char *str)
 {
-    for (; *str; str++) s = outchar(s, t, *str);
-    return s;
+    outmem(o, str, strlen(str));
 }
 
 /**
@@ -107,38 +165,38 @@ static char *outstr(char *s, char *t, const char *str)
  * fit the field width. Earlier steps should convert numerical values to
  * strings, and then call this function to pad and output the value strings.
  *
- * @param   s       Pointer to position in buffer
- * @param   t       Pointer to position one past end of buffer
+ * @param   o       Output state
  * @param   spec    The parsed format specifier (need width and flags)
  * @param   prefix  String such as sign or "0x" prefix that should go
  *                  before any zero-padding, e.g. the "+" in "+00123"
+ * @param   zeros   Number of leading zeros needed to meet precision
  * @param   valstr  String value, e.g. the "123" in "+00123"
+ * @param   valstrlen   Length of the string value
  */
-static char *outpadded(
-        char           *s,
-        char           *t,
+static void outpadded(
+        struct fmtout  *o,
         struct fmtspec *spec,
         const char     *prefix,
-        const char     *valstr
+        size_t          zeros,
+        const char     *valstr,
+        size_t          valstrlen
 )
 {
     /* Calculate lengths. */
     size_t prefixlen = strlen(prefix);
-    size_t valstrlen = strlen(valstr);
 
     /* Calcualte padding. */
-    size_t needwidth = prefixlen + valstrlen;
+    size_t needwidth = prefixlen + zeros + valstrlen;
     size_t w         = spec->w != WP_NONE ? spec->w : 0;
     size_t padlen    = w > needwidth ? w - needwidth : 0;
 
     /* Output with padding.*/
-    if (!spec->left && !spec->zero) s = outpad(s, t, ' ', padlen);
-    s = outstr(s, t, prefix);
-    if (!spec->left && spec->zero) s = outpad(s, t, '0', padlen);
-    s = outstr(s, t, valstr);
-    if (spec->left) s = outpad(s, t, ' ', padlen);
-
-    return s;
+    if (!spec->left && !spec->zero) outpad(o, ' ', padlen);
+    outstr(o, prefix);
+    if (!spec->left && spec->zero) outpad(o, '0', padlen);
+    outpad(o, '0', zeros);
+    outmem(o, valstr, valstrlen);
+    if (spec->left) outpad(o, ' ', padlen);
 }
 
 ///@}
@@ -155,51 +213,74 @@ static const char *sign_prefix(struct fmtspec *spec, bool isneg)
     return "";
 }
 
-/** Convert a string to uppercase. */
-static void strtoupper(char *s)
-{
-    for (; *s; s++) *s = toupper(*s);
-}
-
 ///@}
 
-/** @name Basic number conversions */
+/** @name Basic number conversions
+ *
+ * These write digits right-to-left, ending just before `end`, and return a
+ * pointer to the first digit. A zero value produces no digits at all; the
+ * caller's precision handling adds the "0".
+ */
 ///@{
 
-/** Get a single hex digit for a value from 0 to 15 */
-static inline unsigned hexdigit(unsigned d)
-{
-    return d < 10 ? '0' + d : 'a' + (d - 0xa);
-}
+/** Digit tables, in lowercase and uppercase */
+static const char DIGITS[2][16] = {
+        "0123456789abcdef",
+        "0123456789ABCDEF",
+};
 
-/** Integer to ASCII: decode an unsigned int into a digit string */
-static char *
-itoa(char *s, uintmax_t uval, unsigned base, unsigned precision, unsigned flags
-)
+/** All two-digit decimal numbers, "00" to "99", for two digits per step */
+static const char DEC2[200] = "00010203040506070809"
+                              "10111213141516171819"
+                              "20212223242526272829"
+                              "30313233343536373839"
+                              "40414243444546474849"
+                              "50515253545556575859"
+                              "60616263646566676869"
+                              "70717273747576777879"
+                              "80818283848586878889"
+                              "90919293949596979899";
+
+/** Convert to decimal digits, two digits per division */
+static char *utoa_dec(char *end, uintmax_t uval)
 {
-    /* Decode digits into buffer
-     * (in reverse: least significant digits first). */
-    char  digitbuf[DIGITBUFSZ];
-    char *d = digitbuf;
-    for (; uval; uval /= base) {
-        int digit = uval % base;
-        *d++      = hexdigit(digit);
+    /* Wide divisions are library calls on 32-bit targets,
+     * so only use them until the value fits in a native word. */
+    while (uval > ULONG_MAX) {
+        unsigned r = uval % 100;
+        uval /= 100;
+        end -= 2, memcpy(end, &DEC2[2 * r], 2);
     }
 
-    /* Precision: add leading zeros to meet precision. */
-    char *p = digitbuf + precision;
-    while (d < p) *d++ = '0';
-
-    /* Octal prefix: add one leading zero if it does not already have one. */
-    if (flags & CF_OCTALPREFIX && (d == digitbuf || *(d - 1) != '0'))
-        *d++ = '0';
+    unsigned long val = uval;
+    for (; val >= 100; val /= 100) {
+        unsigned r = val % 100;
+        end -= 2, memcpy(end, &DEC2[2 * r], 2);
+    }
+    if (val >= 10) end -= 2, memcpy(end, &DEC2[2 * val], 2);
+    else if (val) *--end = '0' + val;
+    return end;
+}
 
-    /* Write reversed digits into buffer in correct order. */
-    while (d > digitbuf) *s++ = *--d;
+/** Convert to digits in a power-of-two base, one table lookup per digit */
+static char *
+utoa_pow2(char *end, uintmax_t uval, unsigned shift, const char *digits)
+{
+    unsigned mask = (1u << shift) - 1;
+    for (; uval; uval >>= shift) *--end = digits[uval & mask];
+    return end;
+}
 
-    /* Write a terminator. */
-    *s = '\0';
-    return s;
+/** Integer to ASCII: convert an unsigned int into a digit string */
+static char *utoa(char *end, uintmax_t uval, unsigned base, unsigned flags)
+{
+    const char *digits = DIGITS[!!(flags & CF_UP)];
+    switch (base) {
+    case 2: return utoa_pow2(end, uval, 1, digits);
+    case 8: return utoa_pow2(end, uval, 3, digits);
+    case 16: return utoa_pow2(end, uval, 4, digits);
+    default: return utoa_dec(end, uval);
+    }
 }
 
 ///@}
@@ -234,92 +315,169 @@ static uintmax_t va_arg_unsigned(size_t sz, va_list *args)
     return va_arg(*args, uintmax_t);
 }
 
+/**
+ * Record a raw value into the package, or read it back out
+ *
+ * Does nothing when formatting directly from a va_list. Reads past the end
+ * of a package give zeros.
+ */
+static void arg_xfer(struct fmtargs *a, void *val, size_t sz)
+{
+    bool fits = a->off <= a->len && sz <= a->len - a->off;
+    switch (a->mode) {
+    case ARGS_VA: return;
+    case ARGS_PACK:
+        if (fits) memcpy(a->pkg + a->off, val, sz);
+        break;
+    case ARGS_UNPACK:
+        if (fits) memcpy(val, a->pkg + a->off, sz);
+        else memset(val, 0, sz);
+        break;
+    }
+    a->off += sz;
+}
+
+/** Get a signed integer of desired size (packed as long or intmax_t) */
+static intmax_t arg_signed(struct fmtargs *a, size_t sz)
+{
+    if (sz <= sizeof(long)) {
+        long val = a->mode != ARGS_UNPACK ? va_arg_signed(sz, a->va) : 0;
+        arg_xfer(a, &val, sizeof(val));
+        return val;
+    }
+    intmax_t val = a->mode != ARGS_UNPACK ? va_arg_signed(sz, a->va) : 0;
+    arg_xfer(a, &val, sizeof(val));
+    return val;
+}
+
+/** Get an unsigned integer of desired size (packed as ulong or uintmax_t) */
+static uintmax_t arg_unsigned(struct fmtargs *a, size_t sz)
+{
+    if (sz <= sizeof(unsigned long)) {
+        unsigned long val =
+                a->mode != ARGS_UNPACK ? va_arg_unsigned(sz, a->va) : 0;
+        arg_xfer(a, &val, sizeof(val));
+        return val;
+    }
+    uintmax_t val = a->mode != ARGS_UNPACK ? va_arg_unsigned(sz, a->va) : 0;
+    arg_xfer(a, &val, sizeof(val));
+    return val;
+}
+
+/** Get a string (packed as a copy of the string, with terminator) */
+static const char *arg_str(struct fmtargs *a)
+{
+    if (a->mode != ARGS_UNPACK) {
+        char *str = va_arg(*a->va, char *);
+        if (a->mode == ARGS_PACK) arg_xfer(a, str, strlen(str) + 1);
+        return str;
+    }
+
+    /* Unpacking: the string is right there in the package. */
+    const char *str = a->pkg + a->off;
+    const char *nul = a->off < a->len ? memchr(str, '\0', a->len - a->off)
+                                      : NULL;
+    if (!nul) return a->off = a->len, "";
+    a->off += nul - str + 1;
+    return str;
+}
+
 ///@}
 
 /** @name Formatting logic for each major conversion type */
 ///@{
 
 /** Format a string value ("%s") */
-static char *format_str(char *s, char *t, struct fmtspec *spec, va_list *args)
+static void
+format_str(struct fmtout *o, struct fmtspec *spec, struct fmtargs *args)
 {
     /* Get string pointer from arguments. */
-    char *str = va_arg(*args, char *);
-
-    /* "%s" uses precision to truncate input. Create a truncated string. */
-    if (spec->p != WP_NONE) {
-        char pstr[spec->p + 1];
-        strncpy(pstr, str, spec->p);
-        pstr[spec->p] = '\0'; // Ensure there is a terminator.
-        return outpadded(s, t, spec, "", pstr);
-    }
+    const char *str = arg_str(args);
+
+    /* "%s" uses precision to truncate input. Only measure up to it. */
+    size_t len = 0;
+    if (spec->p != WP_NONE) while (len < (size_t) spec->p && str[len]) len++;
+    else len = strlen(str);
 
-    return outpadded(s, t, spec, "", str);
+    outpadded(o, spec, "", 0, str, len);
 }
 
 /** Format a character value ("%c") */
-static char *format_char(char *s, char *t, struct fmtspec *spec, va_list *args)
+static void
+format_char(struct fmtout *o, struct fmtspec *spec, struct fmtargs *args)
 {
-    /* Get character from arguments and embed it in a string. */
-    char c         = (unsigned char) va_arg(*args, int);
-    char convbuf[] = {c, '\0'};
-    return outpadded(s, t, spec, "", convbuf);
+    /* Get character from arguments. */
+    char c = (unsigned char) arg_signed(args, 0);
+    outpadded(o, spec, "", 0, &c, 1);
 }
 
 /** Format a signed integer ("%d" or "%i") */
-static char *format_signed(
-        char *s, char *t, struct fmtspec *spec, unsigned base, va_list *args
+static void format_signed(
+        struct fmtout  *o,
+        struct fmtspec *spec,
+        unsigned        base,
+        struct fmtargs *args
 )
 {
     /* Get the appropriate type from the arguments. */
-    intmax_t val = va_arg_signed(spec->lenmodsz, args);
+    intmax_t  val  = arg_signed(args, spec->lenmodsz);
+    uintmax_t uval = val < 0 ? -(uintmax_t) val : (uintmax_t) val;
 
     /* Choose sign character. */
     const char *sign = sign_prefix(spec, val < 0);
-    val              = val < 0 ? -val : val;
 
     /* Chcek precision. */
     if (spec->p == WP_NONE) spec->p = 1; // Default precision.
     else spec->zero = false; // If precision given, ignore zero flag.
 
     /* Format digits. */
-    char digitbuf[DIGITBUFSZ];
-    itoa(digitbuf, val, base, spec->p, CF_NONE);
-    return outpadded(s, t, spec, sign, digitbuf);
+    char   digitbuf[DIGITBUFSZ];
+    char  *digitend = digitbuf + DIGITBUFSZ;
+    char  *digits   = utoa(digitend, uval, base, CF_NONE);
+    size_t ndigits  = digitend - digits;
+    size_t zeros    = (size_t) spec->p > ndigits ? spec->p - ndigits : 0;
+    outpadded(o, spec, sign, zeros, digits, ndigits);
 }
 
 /** Format an unsigned integer (u, o, x, X) */
-static char *format_unsigned(
-        char           *s,
-        char           *n,
+static void format_unsigned(
+        struct fmtout  *o,
         struct fmtspec *spec,
         unsigned        base,
         unsigned        flags,
-        va_list        *args
+        struct fmtargs *args
 )
 {
     /* Get the appropriate type from the arguments. */
-    uintmax_t val = va_arg_unsigned(spec->lenmodsz, args);
+    uintmax_t val = arg_unsigned(args, spec->lenmodsz);
 
     /* Choose prefix. */
-    char prefixbuf[PREFIXBUFSZ] = {0};
-    if (spec->alt && base == 8) flags |= CF_OCTALPREFIX;
-    else if (spec->alt && base == 2 && val) strcpy(prefixbuf, "0b");
-    else if (spec->alt && base == 16 && val) strcpy(prefixbuf, "0x");
+    bool        up     = flags & CF_UP;
+    const char *prefix = "";
+    if (spec->alt && base == 2 && val) prefix = up ? "0B" : "0b";
+    else if (spec->alt && base == 16 && val) prefix = up ? "0X" : "0x";
 
     /* Check precision */
     if (spec->p == WP_NONE) spec->p = 1; // Default precision.
     else spec->zero = false; // If precision given, ignore zero flag.
 
     /* Format digits. */
-    char digitbuf[DIGITBUFSZ];
-    itoa(digitbuf, val, base, spec->p, flags);
-    if (flags & CF_UP) strtoupper(prefixbuf), strtoupper(digitbuf);
-    return outpadded(s, n, spec, prefixbuf, digitbuf);
+    char   digitbuf[DIGITBUFSZ];
+    char  *digitend = digitbuf + DIGITBUFSZ;
+    char  *digits   = utoa(digitend, val, base, flags);
+    size_t ndigits  = digitend - digits;
+    size_t zeros    = (size_t) spec->p > ndigits ? spec->p - ndigits : 0;
+
+    /* Octal prefix: add one leading zero if it does not already have one. */
+    if (spec->alt && base == 8 && !zeros && (!ndigits || *digits != '0'))
+        zeros = 1;
+
+    outpadded(o, spec, prefix, zeros, digits, ndigits);
 }
 
 /** Format a pointer ("%p") */
-static char *
-format_pointer(char *s, char *t, struct fmtspec *spec, va_list *args)
+static void
+format_pointer(struct fmtout *o, struct fmtspec *spec, struct fmtargs *args)
 {
     /* Format like a prefixed unsigned hex number. */
     struct fmtspec uspec = {
@@ -328,7 +486,7 @@ format_pointer(char *s, char *t, struct fmtspec *spec, va_list *args)
             .w        = spec->w,
             .lenmodsz = sizeof(void *),
     };
-    return format_unsigned(s, t, &uspec, 16, CF_NONE, args);
+    format_unsigned(o, &uspec, 16, CF_NONE, args);
 }
 
 ///@}
@@ -336,14 +494,21 @@ format_pointer(char *s, char *t, struct fmtspec *spec, va_list *args)
 /** @name Main formatting logic */
 ///@{
 
-/** Parse and process a single conversion specifier ("%s", etc.) */
-static char *
-process_conversion(char *s, char *t, const char **fmt, va_list *args)
+/**
+ * Parse a single conversion specifier ("%s", etc.)
+ *
+ * Consumes any "*" width and precision arguments.
+ *
+ * @returns the conversion character, or -ENOTSUP for an unknown conversion
+ */
+static int
+parse_conversion(const char **fmt, struct fmtspec *spec, struct fmtargs *args)
 {
-    struct fmtspec spec = {.w = WP_NONE, .p = WP_NONE};
-    char          *f    = spec.fmtbuf;  // Copy for debugging
-    int           *wp   = &spec.w;      // Width or precision, start on width
-    bool           zero_is_flag = true; // First zero could be a flag
+    *spec = (struct fmtspec){.w = WP_NONE, .p = WP_NONE};
+
+    char *f            = spec->fmtbuf; // Copy for debugging
+    int  *wp           = &spec->w;     // Width or precision, start on width
+    bool  zero_is_flag = true;         // First zero could be a flag
 
     *f++ = *(*fmt)++; // Consume initial '%' character.
 
@@ -353,14 +518,14 @@ process_conversion(char *s, char *t, const char **fmt, va_list *args)
 
         /* Process consumed character. */
         switch (ch) {
-        case '-': spec.left = true; break;
-        case '+': spec.plus = true; break;
-        case ' ': spec.space = true; break;
-        case '#': spec.alt = true; break;
+        case '-': spec->left = true; break;
+        case '+': spec->plus = true; break;
+        case ' ': spec->space = true; break;
+        case '#': spec->alt = true; break;
 
         case '0': /* Zero: May be a flag or a digit. */
             if (zero_is_flag) {
-                spec.zero    = true;
+                spec->zero   = true;
                 zero_is_flag = false;
                 break;
             }
@@ -381,80 +546,234 @@ process_conversion(char *s, char *t, const char **fmt, va_list *args)
             break;
 
         case '*': /* Star: Get width/precision from args. */
-            *wp = va_arg(*args, int);
+            *wp = arg_signed(args, 0);
 
             /* If width arg is negative, left justify and use abs. val. */
-            if (wp == &spec.w && *wp < 0) spec.left = true, spec.w = -*wp;
+            if (wp == &spec->w && *wp < 0) spec->left = true, spec->w = -*wp;
 
             /* If precision arg is negative, Treat it as unspecified. */
-            if (wp == &spec.p && *wp < 0) spec.p = WP_NONE;
+            if (wp == &spec->p && *wp < 0) spec->p = WP_NONE;
             break;
 
         case '.': /* Dot: Switch from parsing width to parsing precision. */
-            wp           = &spec.p;
-            spec.p       = 0; // Dot with no digits counts as 0.
+            wp           = &spec->p;
+            spec->p      = 0; // Dot with no digits counts as 0.
             zero_is_flag = false;
             break;
 
         case 'h': /* Length modifiler: "h" = short, "hh" = char */
-            if (nextchar == 'h') spec.lenmodsz = sizeof(char), ++*fmt;
-            else spec.lenmodsz = sizeof(short);
+            if (nextchar == 'h') spec->lenmodsz = sizeof(char), ++*fmt;
+            else spec->lenmodsz = sizeof(short);
             break;
 
         case 'l': /* Length modifiler: "l" = long, "ll" = long long */
-            if (nextchar == 'l') spec.lenmodsz = sizeof(long long), ++*fmt;
-            else spec.lenmodsz = sizeof(long);
+            if (nextchar == 'l') spec->lenmodsz = sizeof(long long), ++*fmt;
+            else spec->lenmodsz = sizeof(long);
             break;
 
-        case 'j': spec.lenmodsz = sizeof(intmax_t); break;
-        case 'z': spec.lenmodsz = sizeof(size_t); break;
-        case 't': spec.lenmodsz = sizeof(ptrdiff_t); break;
-        case 'L': spec.lenmodsz = sizeof(long double); break;
-
-        case '%': return outchar(s, t, '%'); // Literal '%'.
-        case 's': return format_str(s, t, &spec, args);
-        case 'c': return format_char(s, t, &spec, args);
+        case 'j': spec->lenmodsz = sizeof(intmax_t); break;
+        case 'z': spec->lenmodsz = sizeof(size_t); break;
+        case 't': spec->lenmodsz = sizeof(ptrdiff_t); break;
+        case 'L': spec->lenmodsz = sizeof(long double); break;
 
+        case '%':
+        case 's':
+        case 'c':
         case 'd':
-        case 'i': return format_signed(s, t, &spec, 10, args);
-        case 'u': return format_unsigned(s, t, &spec, 10, CF_NONE, args);
-        case 'o': return format_unsigned(s, t, &spec, 8, CF_NONE, args);
-        case 'x': return format_unsigned(s, t, &spec, 16, CF_NONE, args);
-        case 'X': return format_unsigned(s, t, &spec, 16, CF_UP, args);
-        case 'b': return format_unsigned(s, t, &spec, 2, CF_NONE, args);
-        case 'B': return format_unsigned(s, t, &spec, 2, CF_UP, args);
-        case 'p': return format_pointer(s, t, &spec, args);
-
-        default: return NULL; // Unknown or unsupported conversion char
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        case 'b':
+        case 'B':
+        case 'p': return ch; // Conversion character: end of pattern.
+
+        default: return -ENOTSUP; // Unknown or unsupported conversion char
         }
     }
 }
 
-/** Inner sprintf implementation */
-static int snprintf_impl(char *s, size_t n, const char *fmt, va_list *args)
+/**
+ * Parse and process a single conversion specifier ("%s", etc.)
+ *
+ * @returns 0 on success, or -ENOTSUP for an unknown conversion
+ */
+static int
+process_conversion(struct fmtout *o, const char **fmt, struct fmtargs *args)
+{
+    struct fmtspec spec;
+    int            conv = parse_conversion(fmt, &spec, args);
+    switch (conv) {
+    // clang-format off
+    case '%': outchar(o, '%'); return 0; // Literal '%'.
+    case 's': format_str(o, &spec, args); return 0;
+    case 'c': format_char(o, &spec, args); return 0;
+
+    case 'd':
+    case 'i': format_signed(o, &spec, 10, args); return 0;
+    case 'u': format_unsigned(o, &spec, 10, CF_NONE, args); return 0;
+    case 'o': format_unsigned(o, &spec, 8, CF_NONE, args); return 0;
+    case 'x': format_unsigned(o, &spec, 16, CF_NONE, args); return 0;
+    case 'X': format_unsigned(o, &spec, 16, CF_UP, args); return 0;
+    case 'b': format_unsigned(o, &spec, 2, CF_NONE, args); return 0;
+    case 'B': format_unsigned(o, &spec, 2, CF_UP, args); return 0;
+    case 'p': format_pointer(o, &spec, args); return 0;
+    // clang-format on
+
+    default: return conv < 0 ? conv : -ENOTSUP;
+    }
+}
+
+/**
+ * Parse a single conversion specifier and record its argument in a package
+ *
+ * This takes the arguments in the same order and with the same types that
+ * @ref process_conversion will later take them, but does no formatting.
+ *
+ * @returns 0 on success, or -ENOTSUP for an unknown conversion
+ */
+static int pack_conversion(const char **fmt, struct fmtargs *args)
+{
+    struct fmtspec spec;
+    int            conv = parse_conversion(fmt, &spec, args);
+    switch (conv) {
+    case '%': return 0;
+    case 's': arg_str(args); return 0;
+    case 'c': arg_signed(args, 0); return 0;
+    case 'd':
+    case 'i': arg_signed(args, spec.lenmodsz); return 0;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+    case 'b':
+    case 'B': arg_unsigned(args, spec.lenmodsz); return 0;
+    case 'p': arg_unsigned(args, sizeof(void *)); return 0;
+    default: return conv < 0 ? conv : -ENOTSUP;
+    }
+}
+
+/**
+ * Fast path for the most common conversions, with no flags, width,
+ * precision, or length modifier: "%d", "%u", "%x", "%p" and "%s"
+ *
+ * @returns true if the conversion was handled, false if it needs the
+ *          full parser
+ */
+static bool format_fast(struct fmtout *o, char conv, struct fmtargs *args)
 {
-    char *bufstart = s;                  // Save start of buffer for later.
-    char *t        = s + n;              // Calculate end of buffer.
-    if (t < s) t = (char *) UINTPTR_MAX; // Avoid wraparound.
+    char  buf[PREFIXBUFSZ + DIGITBUFSZ];
+    char *end = buf + sizeof(buf), *s;
+
+    switch (conv) {
+    case 's': outstr(o, arg_str(args)); return true;
+    case 'd': {
+        int val = arg_signed(args, 0);
+        s       = utoa_dec(end, val < 0 ? -(unsigned) val : (unsigned) val);
+        if (!val) *--s = '0';
+        if (val < 0) *--s = '-';
+        break;
+    }
+    case 'u':
+        s = utoa_dec(end, arg_unsigned(args, 0));
+        if (s == end) *--s = '0';
+        break;
+    case 'x':
+        s = utoa_pow2(end, arg_unsigned(args, 0), 4, DIGITS[0]);
+        if (s == end) *--s = '0';
+        break;
+    case 'p': {
+        uintptr_t val = arg_unsigned(args, sizeof(void *));
+        s             = utoa_pow2(end, val, 4, DIGITS[0]);
+        if (val) s -= 2, memcpy(s, "0x", 2); // Same as "%#x".
+        else *--s = '0';
+        break;
+    }
+    default: return false;
+    }
+
+    outmem(o, s, end - s);
+    return true;
+}
 
+/** Inner formatting loop, shared by the buffer and stream interfaces */
+static int
+format_impl(struct fmtout *o, const char *fmt, struct fmtargs *args)
+{
     /* Main loop: process characters in format string. */
     for (;;) {
         /* Copy non-pattern characters directly. */
-        for (; *fmt && *fmt != '%'; fmt++) s = outchar(s, t, *fmt);
+        const char *lit = fmt;
+        while (*fmt && *fmt != '%') fmt++;
+        outmem(o, lit, fmt - lit);
         if (!*fmt) break;
 
+        /* Handle common plain patterns without the full parser. */
+        if (format_fast(o, fmt[1], args)) {
+            fmt += 2;
+            continue;
+        }
+
         /* Parse and interpret encountered pattern. */
-        s = process_conversion(s, t, &fmt, args);
-        if (!s) return -ENOTSUP; // Report error.
+        int res = process_conversion(o, &fmt, args);
+        if (res < 0) return res; // Report error.
     }
+    return 0;
+}
+
+/** Inner sprintf implementation */
+static int snprintf_impl(char *s, size_t n, const char *fmt, va_list *va)
+{
+    struct fmtout o = {.pos = s, .end = s + n};  // Calculate end of buffer.
+    if (o.end < s) o.end = (char *) UINTPTR_MAX; // Avoid wraparound.
+
+    struct fmtargs args = {.mode = ARGS_VA, .va = va};
+    int            res  = format_impl(&o, fmt, &args);
+    if (res < 0) return res;
 
     /* Write a terminator. */
     if (n) {
-        if (s < t) *s = '\0'; // Either end of string,
-        else *(t - 1) = '\0'; // or at end of buffer.
+        if (o.pos < o.end) *o.pos = '\0'; // Either end of string,
+        else *(o.end - 1) = '\0';         // or at end of buffer.
     }
 
-    return s - bufstart;
+    return o.count;
+}
+
+/**
+ * Inner streaming implementation: format into the stream's buffer
+ *
+ * Output is appended to whatever is already buffered in the stream.
+ * Whenever the buffer fills, it is handed to the sink and reused, so stack
+ * use stays the same no matter how long the output is.
+ */
+static int
+fmtstream_impl(struct fmtstream *fs, const char *fmt, struct fmtargs *args)
+{
+    struct fmtout o = {
+            .pos    = fs->buf + fs->len,
+            .end    = fs->buf + sizeof(fs->buf),
+            .stream = fs,
+    };
+
+    int res = format_impl(&o, fmt, args);
+
+    fs->len = o.pos - fs->buf;
+    fs->count += o.count;
+    if (res < 0) return res;
+    if (fs->err < 0) return fs->err;
+    return o.count;
+}
+
+/** Inner packing implementation: record args without formatting */
+static int pack_impl(struct fmtargs *args, const char *fmt)
+{
+    while ((fmt = strchr(fmt, '%'))) {
+        int res = pack_conversion(&fmt, args);
+        if (res < 0) return res;
+    }
+    return args->off;
 }
 
 ///@}
@@ -518,3 +837,157 @@ int sprintf(char *s, const char *format, ...)
 }
 
 ///@}
+
+/** @name Public streaming interfaces */
+///@{
+
+/**
+ * Set up a format stream that sends output to a sink callback.
+ */
+void fmtstream_init(struct fmtstream *fs, fmt_sink_fn *sink, void *ctx)
+{
+    *fs = (struct fmtstream){.sink = sink, .ctx = ctx};
+}
+
+/**
+ * Format into a stream, with args from va_list.
+ *
+ * @returns number of chars formatted, or a negative error code from the
+ *          formatter or the sink.
+ */
+int fmtstream_vprintf(struct fmtstream *fs, const char *format, va_list args)
+{
+    va_list argscopy;
+    va_copy(argscopy, args); // Copy so we can get a pointer.
+    struct fmtargs a   = {.mode = ARGS_VA, .va = &argscopy};
+    int            res = fmtstream_impl(fs, format, &a);
+    va_end(argscopy);
+    return res;
+}
+
+/**
+ * Format into a stream.
+ */
+ATTR_PRINTFLIKE(2, 3)
+int fmtstream_printf(struct fmtstream *fs, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    struct fmtargs a   = {.mode = ARGS_VA, .va = &args};
+    int            res = fmtstream_impl(fs, format, &a);
+    va_end(args);
+    return res;
+}
+
+/**
+ * Hand any remaining buffered output to the sink.
+ *
+ * @returns total number of chars formatted through the stream, or the first
+ *          negative error code returned by the sink.
+ */
+int fmtstream_flush(struct fmtstream *fs)
+{
+    if (fs->len && !fs->err) {
+        int res = fs->sink(fs->ctx, fs->buf, fs->len);
+        if (res < 0) fs->err = res;
+    }
+    fs->len = 0;
+    return fs->err < 0 ? fs->err : (int) fs->count;
+}
+
+/**
+ * Format once, straight to a sink callback, with args from va_list.
+ *
+ * This is the streaming counterpart of @ref vsnprintf: output goes to the
+ * sink in chunks while formatting, so there is no need to guess a buffer size
+ * or to format twice.
+ */
+int vcbprintf(fmt_sink_fn *sink, void *ctx, const char *format, va_list args)
+{
+    struct fmtstream fs;
+    fmtstream_init(&fs, sink, ctx);
+    int res = fmtstream_vprintf(&fs, format, args);
+    if (res < 0) return res;
+    return fmtstream_flush(&fs);
+}
+
+/**
+ * Format once, straight to a sink callback.
+ */
+ATTR_PRINTFLIKE(3, 4)
+int cbprintf(fmt_sink_fn *sink, void *ctx, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int res = vcbprintf(sink, ctx, format, args);
+    va_end(args);
+    return res;
+}
+
+///@}
+
+/** @name Public argument packing interfaces */
+///@{
+
+/**
+ * Record the arguments for a format string, to be formatted later.
+ *
+ * Integer and pointer arguments are stored as raw values, and strings are
+ * copied, so the package stays valid after the caller's buffers are gone.
+ * The format string itself is not copied: it must outlive the package,
+ * which is the case for string literals.
+ *
+ * @param   buf     Buffer for the package
+ * @param   n       Size of buffer
+ * @returns size of package (which may be larger than n, as with snprintf),
+ *          or a negative error code for an invalid format string
+ */
+int vfmtpack(void *buf, size_t n, const char *format, va_list args)
+{
+    va_list argscopy;
+    va_copy(argscopy, args); // Copy so we can get a pointer.
+    struct fmtargs a = {
+            .mode = ARGS_PACK,
+            .va   = &argscopy,
+            .pkg  = buf,
+            .len  = n,
+    };
+    int res = pack_impl(&a, format);
+    va_end(argscopy);
+    return res;
+}
+
+/**
+ * Record the arguments for a format string, to be formatted later.
+ */
+ATTR_PRINTFLIKE(3, 4)
+int fmtpack(void *buf, size_t n, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int res = vfmtpack(buf, n, format, args);
+    va_end(args);
+    return res;
+}
+
+/**
+ * Format into a stream, with args from a package made by @ref vfmtpack.
+ *
+ * @param   fs      Stream
+ * @param   format  The same format string the package was made with
+ * @param   pkg     Package
+ * @param   n       Size of package
+ */
+int fmtstream_pkprintf(
+        struct fmtstream *fs, const char *format, const void *pkg, size_t n
+)
+{
+    struct fmtargs a = {
+            .mode = ARGS_UNPACK,
+            .pkg  = (char *) pkg,
+            .len  = n,
+    };
+    return fmtstream_impl(fs, format, &a);
+}
+
+///@}
@@ -22,4 +22,63 @@ ATTR_PRINTFLIKE(3, 4)
 int snprintf(char *s, size_t n, const char *format, ...);
 int vsnprintf(char *s, size_t n, const char *format, va_list args);
 
+/**
+ * @name Streaming output
+ *
+ * Format once and hand the output to a sink callback in small chunks,
+ * instead of formatting into a caller-supplied buffer. Stack use is bounded
+ * by @ref FMTSTREAM_BUFSZ no matter how long the output is.
+ */
+///@{
+
+/**
+ * Sink callback for streaming output
+ *
+ * @param   ctx     Context pointer given when the stream was set up
+ * @param   buf     Chunk of formatted output (not null-terminated)
+ * @param   n       Length of the chunk
+ * @returns 0 on success, or a negative error code to stop further output
+ */
+typedef int fmt_sink_fn(void *ctx, const char *buf, size_t n);
+
+#define FMTSTREAM_BUFSZ 64 ///< Size of a stream's chunk buffer
+
+/** Format stream: chunk buffer and sink, shared across several printf calls */
+struct fmtstream {
+    fmt_sink_fn *sink;  ///< Where to send full chunks
+    void        *ctx;   ///< Context pointer for sink
+    size_t       len;   ///< Number of chars waiting in buffer
+    size_t       count; ///< Total number of chars formatted
+    int          err;   ///< First error returned by sink
+    char         buf[FMTSTREAM_BUFSZ]; ///< Chunk buffer
+};
+
+void fmtstream_init(struct fmtstream *fs, fmt_sink_fn *sink, void *ctx);
+ATTR_PRINTFLIKE(2, 3)
+int fmtstream_printf(struct fmtstream *fs, const char *format, ...);
+int fmtstream_vprintf(struct fmtstream *fs, const char *format, va_list args);
+int fmtstream_flush(struct fmtstream *fs);
+
+ATTR_PRINTFLIKE(3, 4)
+int cbprintf(fmt_sink_fn *sink, void *ctx, const char *format, ...);
+int vcbprintf(fmt_sink_fn *sink, void *ctx, const char *format, va_list args);
+
+///@}
+
+/**
+ * @name Argument packing
+ *
+ * Record the arguments of a printf call now, and format them later.
+ */
+///@{
+
+ATTR_PRINTFLIKE(3, 4)
+int fmtpack(void *buf, size_t n, const char *format, ...);
+int vfmtpack(void *buf, size_t n, const char *format, va_list args);
+int fmtstream_pkprintf(
+        struct fmtstream *fs, const char *format, const void *pkg, size_t n
+);
+
+///@}
+
 #endif /* KPRINTF_H */
@@ -1,16 +1,159 @@
 #include "string.h"
 
+#include <core/compiler.h>
+#include <core/macros.h>
+
 #include <stdint.h>
 
+/**
+ * @name Word-at-a-time memory access
+ *
+ * The memory functions below move or compare one machine word per loop
+ * iteration instead of one byte. Each call is split into three parts:
+ *
+ *  1. Head: single bytes until the destination is word-aligned.
+ *  2. Body: whole words.
+ *  3. Tail: the remaining bytes that do not fill a whole word.
+ *
+ * Very short calls skip straight to the byte loop, since the head/tail setup
+ * would cost more than it saves. Very long calls on i386 use the CPU's string
+ * instructions (`rep movsl` and `rep stosl`) for the body. Their startup cost
+ * is about that of a 128-byte word loop, so they only pay off from
+ * @ref REP_MIN up. `rep movsl` is only fast if the source is aligned too:
+ * from an unaligned source it is slower than the word loop up to ~16 KiB.
+ *
+ * The string functions scan a word at a time too, but they must not read
+ * past the terminator into memory that might not exist. So they only ever
+ * read _aligned_ words. An aligned word never straddles a page boundary, so
+ * if any byte of the word is valid, the whole word is safe to read.
+ */
+///@{
+
+/** Machine word type that may be used to access any buffer */
+typedef unsigned long ATTR_MAY_ALIAS word_t;
+
+/** Word type for loads from addresses that may not be word-aligned */
+typedef unsigned long ATTR_MAY_ALIAS ATTR_ALIGNED(1) uword_t;
+
+#define WORDSZ   sizeof(word_t) ///< Bytes per word
+#define WORDMASK (WORDSZ - 1)   ///< Mask for offset within a word
+
+#define WORD_MIN (2 * WORDSZ) ///< Below this size, use only the byte loop
+#define REP_MIN  256          ///< From this size up, use `rep` instructions
+
+/**
+ * @def UNALIGNED_OK
+ * Can the CPU read words from unaligned addresses?
+ *
+ * On x86 it can, so we only need to align the destination pointer, and the
+ * source can be at any offset. Source loads go through @ref uword_t, so the
+ * compiler knows they may be unaligned. Other CPUs need both pointers to
+ * share the same alignment for the word loop.
+ */
+#if __i386__ || __x86_64__
+#define UNALIGNED_OK 1
+#else
+#define UNALIGNED_OK 0
+#endif
+
+/** Can these two pointers be used together in a word loop? */
+static inline int can_wordcopy(const void *a, const void *b, size_t n)
+{
+    if (n < WORD_MIN) return 0;
+    return UNALIGNED_OK || !(((uintptr_t) a ^ (uintptr_t) b) & WORDMASK);
+}
+
+/** Fill a word with copies of a byte, e.g. 0xab -> 0xabababab */
+static inline word_t word_splat(unsigned char c)
+{
+    return (word_t) -1 / 0xff * c;
+}
+
+/**
+ * Does this word contain a zero byte?
+ *
+ * This is the classic "has zero byte" bit trick: subtracting 1 from each byte
+ * only borrows into a byte's high bit if that byte was zero (or already had
+ * its high bit set, which the `~w` term filters out). The result is nonzero
+ * if and only if at least one byte of the word is zero.
+ *
+ * @see
+ * - [Bit Twiddling Hacks: Determine if a word has a zero byte](
+        https://graphics.stanford.edu/~seander/bithacks.html#ZeroInWord)
+ */
+static inline word_t word_haszero(word_t w)
+{
+    const word_t ones = word_splat(0x01), highs = word_splat(0x80);
+    return (w - ones) & ~w & highs;
+}
+
+#if __i386__
+static inline void
+rep_movsl(unsigned char **d, const unsigned char **s, size_t nwords)
+{
+    asm volatile("rep movsl"
+                 : "+D"(*d), "+S"(*s), "+c"(nwords)
+                 :
+                 : "memory");
+}
+
+static inline void rep_stosl(unsigned char **d, word_t w, size_t nwords)
+{
+    asm volatile("rep stosl" : "+D"(*d), "+c"(nwords) : "a"(w) : "memory");
+}
+#endif
+
+/** Copy low to high. Also safe for overlapping areas where dest < src. */
+static void copy_fwd(unsigned char *d, const unsigned char *s, size_t n)
+{
+    if (can_wordcopy(d, s, n)) {
+        /* Head: copy bytes until destination is aligned. */
+        for (; (uintptr_t) d & WORDMASK; n--) *d++ = *s++;
+
+        /* Body: copy words. */
+        size_t nwords = n / WORDSZ;
+        n             = n % WORDSZ;
+#if __i386__
+        if (nwords * WORDSZ >= REP_MIN && !((uintptr_t) s & WORDMASK))
+            rep_movsl(&d, &s, nwords), nwords = 0;
+#endif
+        for (; nwords; nwords--, d += WORDSZ, s += WORDSZ)
+            *(word_t *) d = *(const uword_t *) s;
+    }
+
+    /* Tail (or whole copy if too short for words). */
+    for (; n; n--) *d++ = *s++;
+}
+
+/** Copy high to low. Safe for overlapping areas where dest > src. */
+static void copy_bwd(unsigned char *d, const unsigned char *s, size_t n)
+{
+    /* Start from the ends and work down. */
+    d += n, s += n;
+
+    if (can_wordcopy(d, s, n)) {
+        /* Head (at the high end): copy bytes until destination is aligned. */
+        for (; (uintptr_t) d & WORDMASK; n--) *--d = *--s;
+
+        /* Body: copy words. */
+        for (; n >= WORDSZ; n -= WORDSZ) {
+            d -= WORDSZ, s -= WORDSZ;
+            *(word_t *) d = *(const uword_t *) s;
+        }
+    }
+
+    /* Tail (at the low end). */
+    for (; n; n--) *--d = *--s;
+}
+
+///@}
+
 /**
  * Copy memory area (not overlap safe)
  */
 void *memcpy(void *restrict dest, const void *restrict src, size_t count)
 {
-    const unsigned char *restrict bsrc = src;
-    for (unsigned char *cur = dest; count > 0; count--, cur++, bsrc++)
-        *cur = *(unsigned char *) bsrc;
-
+    copy_fwd(dest, src, count);
     return dest;
 }
 
@@ -21,17 +164,10 @@ void *memmove(void *dest, const void *src, size_t n)
 {
     if (n == 0 || src == dest) return dest;
 
-    if (src > dest) {
-        /* If source is higher than dest, copy from low to high. */
-        const unsigned char *s = src;
-        unsigned char       *d = dest;
-        for (; n; n--) *(d++) = *(s++);
-    } else {
-        /* If source is lower dest, copy from high to low. */
-        const unsigned char *s = src + n;
-        unsigned char       *d = dest + n;
-        for (; n; n--) *--d = *--s;
-    }
+    /* If source is higher than dest, copy from low to high.
+     * If source is lower dest, copy from high to low. */
+    if (src > dest) copy_fwd(dest, src, n);
+    else copy_bwd(dest, src, n);
     return dest;
 }
 
@@ -40,7 +176,24 @@ void *memmove(void *dest, const void *src, size_t n)
  */
 void *memset(void *s, int c, size_t n)
 {
-    for (unsigned char *cur = s; n > 0; n--, cur++) *cur = (unsigned char) c;
+    unsigned char *d = s;
+
+    if (n >= WORD_MIN) {
+        /* Head: fill bytes until aligned. */
+        for (; (uintptr_t) d & WORDMASK; n--) *d++ = (unsigned char) c;
+
+        /* Body: fill words. */
+        word_t w      = word_splat(c);
+        size_t nwords = n / WORDSZ;
+        n             = n % WORDSZ;
+#if __i386__
+        if (nwords * WORDSZ >= REP_MIN) rep_stosl(&d, w, nwords), nwords = 0;
+#endif
+        for (; nwords; nwords--, d += WORDSZ) *(word_t *) d = w;
+    }
+
+    /* Tail. */
+    for (; n; n--) *d++ = (unsigned char) c;
     return s;
 }
 
@@ -52,6 +205,17 @@ int memcmp(const void *s1, const void *s2, size_t n)
     const unsigned char *b1 = s1;
     const unsigned char *b2 = s2;
 
+    if (can_wordcopy(b1, b2, n)) {
+        /* Head: compare bytes until the first pointer is aligned. */
+        for (; (uintptr_t) b1 & WORDMASK; n--, b1++, b2++)
+            if (*b1 != *b2) return *b1 < *b2 ? -1 : 1;
+
+        /* Body: skip over equal words. The first differing word is left
+         * for the byte loop, which will find the differing byte. */
+        for (; n >= WORDSZ; n -= WORDSZ, b1 += WORDSZ, b2 += WORDSZ)
+            if (*(const word_t *) b1 != *(const uword_t *) b2) break;
+    }
+
     for (; n > 0; n--, b1++, b2++) {
         if (*b1 < *b2) return -1;
         if (*b1 > *b2) return 1;
@@ -114,6 +278,17 @@ char *strncat(char *dest, const char *src, size_t n)
 
 int strcmp(const char *s, const char *t)
 {
+    /* If both strings share an alignment, skip over equal words. */
+    if (!(((uintptr_t) s ^ (uintptr_t) t) & WORDMASK)) {
+        for (; (uintptr_t) s & WORDMASK && *s && *s == *t; s++, t++);
+        if (!((uintptr_t) s & WORDMASK)) {
+            const word_t *ws = (const void *) s, *wt = (const void *) t;
+            for (; *ws == *wt && !word_haszero(*ws); ws++, wt++);
+            s = (const char *) ws, t = (const char *) wt;
+        }
+    }
+
+    /* Find the differing byte or terminator. */
     for (;; s++, t++) {
         if (*s && *t && *s == *t) continue;
         if (*s < *t) return -1;
@@ -130,6 +305,17 @@ int strcmp(const char *s, const char *t)
  */
 int strncmp(const char *s, const char *t, size_t n)
 {
+    /* If both strings share an alignment, skip over equal words. */
+    if (!(((uintptr_t) s ^ (uintptr_t) t) & WORDMASK)) {
+        for (; n && (uintptr_t) s & WORDMASK && *s && *s == *t; s++, t++, n--);
+        if (!((uintptr_t) s & WORDMASK)) {
+            const word_t *ws = (const void *) s, *wt = (const void *) t;
+            for (; n >= WORDSZ && *ws == *wt && !word_haszero(*ws);
+                 ws++, wt++, n -= WORDSZ);
+            s = (const char *) ws, t = (const char *) wt;
+        }
+    }
+
     for (; n; s++, t++, n--) {
         if (*s && *t && *s == *t) continue;
         if (*s < *t) return -1;
@@ -145,22 +331,156 @@ size_t strlen(const char *s)
     /* Note that there is no null-pointer check here.
      * This is dictated by the C Standard: "The behavior is undefined if str is
      * not a pointer to a null-terminated byte string." */
-    size_t n;
-    for (n = 0; *s != '\0'; s++) n++;
-    return n;
+    const char *pos = s;
+
+    /* Head: check bytes until aligned. */
+    for (; (uintptr_t) pos & WORDMASK; pos++)
+        if (!*pos) return pos - s;
+
+    /* Body: skip words that have no terminator. */
+    const word_t *w = (const void *) pos;
+    while (!word_haszero(*w)) w++;
+
+    /* Tail: find the terminator within the last word. */
+    for (pos = (const char *) w; *pos; pos++);
+    return pos - s;
 }
 
 char *strchr(const char *str, int ch)
 {
-    for (;; str++)
-        if (*str == (char) ch) return (char *) str;
+    const char c = ch;
+
+    /* Head: check bytes until aligned. */
+    for (; (uintptr_t) str & WORDMASK; str++)
+        if (*str == c) return (char *) str;
+        else if (!*str) return NULL;
+
+    /* Body: skip words that have neither the char nor a terminator.
+     * XOR-ing with the char turns matching bytes into zeroes. */
+    const word_t *w  = (const void *) str;
+    const word_t  cw = word_splat(c);
+    while (!word_haszero(*w) && !word_haszero(*w ^ cw)) w++;
+
+    /* Tail: find the char or terminator within the last word. */
+    for (str = (const char *) w;; str++)
+        if (*str == c) return (char *) str;
         else if (!*str) return NULL;
 }
 
-char *strstr(const char *str, const char *substr)
+void *memchr(const void *s, int c, size_t n)
 {
-    int substrlen = strlen(substr);
-    for (; *str; str++)
-        if (strncmp(str, substr, substrlen) == 0) return (char *) str;
+    const unsigned char *pos = s, uc = c;
+
+    /* Head: check bytes until aligned. */
+    for (; n && (uintptr_t) pos & WORDMASK; pos++, n--)
+        if (*pos == uc) return (void *) pos;
+
+    /* Body: skip words that do not contain the char. */
+    const word_t *w  = (const void *) pos;
+    const word_t  cw = word_splat(uc);
+    for (; n >= WORDSZ && !word_haszero(*w ^ cw); w++, n -= WORDSZ);
+
+    /* Tail. */
+    for (pos = (const unsigned char *) w; n; pos++, n--)
+        if (*pos == uc) return (void *) pos;
     return NULL;
 }
+
+/**
+ * Two-Way string matching, for needles of two or more chars
+ *
+ * Two-Way splits the needle at its "critical factorization" and then matches
+ * the right half left-to-right and the left half right-to-left. On a mismatch
+ * it can shift by the needle's period, so the search takes O(n + m) time and
+ * O(1) extra space, even for needles like "aaab" that make the naive
+ * approach O(n * m).
+ *
+ * Adapted from musl libc's `twoway_strstr` (src/string/strstr.c), minus its
+ * bad-character shift table.
+ *
+ * @see
+ * - Crochemore and Perrin, "Two-way string-matching", JACM 38(3), 1991.
+ * - [musl strstr.c](https://git.musl-libc.org/cgit/musl/tree/src/string/strstr.c)
+ */
+static char *twoway_strstr(const unsigned char *h, const unsigned char *n)
+{
+    const unsigned char *z;
+    size_t               l, ip, jp, k, p, ms, p0, mem, mem0;
+
+    /* Compute needle length. Stop early if the haystack is shorter. */
+    for (l = 0; n[l] && h[l]; l++);
+    if (n[l]) return NULL;
+
+    /* Compute maximal suffix. */
+    ip = -1, jp = 0, k = p = 1;
+    while (jp + k < l) {
+        if (n[ip + k] == n[jp + k]) {
+            if (k == p) jp += p, k = 1;
+            else k++;
+        } else if (n[ip + k] > n[jp + k]) {
+            jp += k, k = 1, p = jp - ip;
+        } else {
+            ip = jp++, k = p = 1;
+        }
+    }
+    ms = ip, p0 = p;
+
+    /* And with the opposite comparison. */
+    ip = -1, jp = 0, k = p = 1;
+    while (jp + k < l) {
+        if (n[ip + k] == n[jp + k]) {
+            if (k == p) jp += p, k = 1;
+            else k++;
+        } else if (n[ip + k] < n[jp + k]) {
+            jp += k, k = 1, p = jp - ip;
+        } else {
+            ip = jp++, k = p = 1;
+        }
+    }
+    if (ip + 1 > ms + 1) ms = ip;
+    else p = p0;
+
+    /* Periodic needle? */
+    if (memcmp(n, n + p, ms + 1)) mem0 = 0, p = MAX(ms, l - ms - 1) + 1;
+    else mem0 = l - p;
+    mem = 0;
+
+    /* Search loop. Track a known-safe end of haystack in z, extending it
+     * in chunks so that we never read past the terminator. */
+    for (z = h;;) {
+        if ((size_t) (z - h) < l) {
+            size_t               grow = l | 63;
+            const unsigned char *z2   = memchr(z, 0, grow);
+            if (z2) {
+                z = z2;
+                if ((size_t) (z - h) < l) return NULL;
+            } else z += grow;
+        }
+
+        /* Compare right half. */
+        for (k = MAX(ms + 1, mem); n[k] && n[k] == h[k]; k++);
+        if (n[k]) {
+            h += k - ms, mem = 0;
+            continue;
+        }
+
+        /* Compare left half. */
+        for (k = ms + 1; k > mem && n[k - 1] == h[k - 1]; k--);
+        if (k <= mem) return (char *) h;
+        h += p, mem = mem0;
+    }
+}
+
+char *strstr(const char *str, const char *substr)
+{
+    /* Note: an empty haystack never matches, not even an empty needle.
+     * (The C Standard would return the empty haystack in that case.) */
+    if (!*str) return NULL;
+    if (!*substr) return (char *) str;
+
+    /* Jump to the first possible match. */
+    str = strchr(str, *substr);
+    if (!str || !substr[1]) return (char *) str;
+
+    return twoway_strstr((const void *) str, (const void *) substr);
+}
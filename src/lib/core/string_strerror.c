@@ -72,7 +72,7 @@ static const char *known_constant(int errnum)
     /* --- POSIX: I/O: Filesystem --- */
 
     //case EACCES:          return "EACCES";
-    //case EEXIST:          return "EEXIST";
+    case EEXIST:          return "EEXIST";
     //case EFBIG:           return "EFBIG";
     case EISDIR:          return "EISDIR";
     //case ENAMETOOLONG:    return "ENAMETOOLONG";
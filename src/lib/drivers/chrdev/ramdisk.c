@@ -3,30 +3,38 @@
 #include <drivers/vfs.h>
 
 #include <core/errno.h>
+#include <core/list.h>
 #include <core/macros.h>
+#include <core/slab.h>
 #include <core/sprintf.h>
-
-#define RAMDISKS_MAX 4
+#include <core/string.h>
 
 struct ramdisk {
-    char       *addr;
-    size_t      rd_size;
-    const char *name;
+    struct list_head list; ///< Entry in @ref ramdisks
+    unsigned         minor;
+    char            *addr;
+    size_t           rd_size;
+    const char      *name;
 };
 
-static struct ramdisk ramdisks[RAMDISKS_MAX];
+static KMEM_CACHE(ramdisk_cache, "ramdisk", struct ramdisk, NULL);
+static LIST_HEAD(ramdisks);
+static unsigned next_minor;
 
 static int ramdisk_create_inner(void *addr, size_t size, const char *name)
 {
     if (!addr || !size) return -EINVAL;
-    for (int i = 0; i < RAMDISKS_MAX; i++) {
-        if (!ramdisks[i].addr) {
-            ramdisks[i] = (struct ramdisk
-            ){.addr = addr, .rd_size = size, .name = name};
-            return i;
-        }
-    }
-    return -ENOMEM;
+
+    struct ramdisk *rd = kmem_cache_alloc(&ramdisk_cache);
+    if (!rd) return -ENOMEM;
+    *rd = (struct ramdisk){
+            .minor   = next_minor++,
+            .addr    = addr,
+            .rd_size = size,
+            .name    = name,
+    };
+    list_add_tail(&rd->list, &ramdisks);
+    return rd->minor;
 }
 
 int ramdisk_create(void *addr, size_t size, const char *name)
@@ -41,14 +49,15 @@ int ramdisk_create(void *addr, size_t size, const char *name)
 
 static int ramdisk_open_dev(struct file *file, unsigned min)
 {
-    /* Use minor number as ramdisk index. */
-    unsigned disk_no = min;
-    if (disk_no >= RAMDISKS_MAX || !ramdisks[disk_no].addr) return -ENODEV;
-    struct ramdisk *rd = &ramdisks[disk_no];
-
-    file->f_driver_data = rd;
-    file->f_stat.f_size = rd->rd_size;
-    return 0;
+    struct ramdisk *rd;
+    list_for_each_entry(rd, &ramdisks, list)
+    {
+        if (rd->minor != min) continue;
+        file->f_driver_data = rd;
+        file->f_stat.f_size = rd->rd_size;
+        return 0;
+    }
+    return -ENODEV;
 }
 
 static int ramdisk_debugstr(char *descbuf, size_t n, struct file *f)
@@ -57,27 +66,51 @@ static int ramdisk_debugstr(char *descbuf, size_t n, struct file *f)
     return snprintf(descbuf, n, "ramdisk{%s %p}", rd->name, rd->addr);
 }
 
+/** Get the ramdisk memory at off, and how many bytes are left from there */
+static ssize_t ramdisk_direct_access(
+        struct file *f, loff_t off, size_t len, void **kaddr
+)
+{
+    struct ramdisk *rd = f->f_driver_data;
+    if (off < 0) return -EINVAL;
+    if (off >= f->f_stat.f_size) return 0; // Past end of file: EOF.
+
+    *kaddr = rd->addr + off;
+    return MIN(len, (size_t) (f->f_stat.f_size - off));
+}
+
 static ssize_t
 ramdisk_read(struct file *f, void *dst, size_t count, loff_t *off)
 {
-    UNUSED(off);
-    struct ramdisk *rd = f->f_driver_data;
+    if (*off < 0) *off = 0; // Do not go below zero.
 
-    unsigned char *bdst = dst;
-    if (*off < 0) *off = 0;                 // Do not go below zero.
-    if (*off >= f->f_stat.f_size) return 0; // If past end of file, EOF.
+    void   *src;
+    ssize_t n = ramdisk_direct_access(f, *off, count, &src);
+    if (n <= 0) return n;
 
-    size_t i = 0;
-    for (; i < count && *off < f->f_stat.f_size; i++, (*off)++, bdst++)
-        *bdst = *(rd->addr + *off);
-    return i;
+    memcpy(dst, src, n);
+    *off += n;
+    return n;
+}
+
+static int ramdisk_phys_addr(
+        struct file *f, loff_t off, size_t len, uintptr_t *paddr
+)
+{
+    void   *kaddr;
+    ssize_t n = ramdisk_direct_access(f, off, len, &kaddr);
+    if (n <= 0 || (size_t) n < len) return -EINVAL;
+    *paddr = (uintptr_t) kaddr; // Kernel memory is identity-mapped.
+    return 0;
 }
 
 static struct file_operations ramdisk_ops = {
-        .name     = "ramdisk",
-        .open_dev = ramdisk_open_dev,
-        .debugstr = ramdisk_debugstr,
-        .read     = ramdisk_read,
+        .name          = "ramdisk",
+        .open_dev      = ramdisk_open_dev,
+        .debugstr      = ramdisk_debugstr,
+        .read          = ramdisk_read,
+        .direct_access = ramdisk_direct_access,
+        .phys_addr     = ramdisk_phys_addr,
 };
 
 int init_driver_ramdisk(void)
@@ -5,25 +5,28 @@
 
 #include <core/ctype.h>
 #include <core/errno.h>
+#include <core/list.h>
 #include <core/macros.h>
+#include <core/slab.h>
 #include <core/string.h>
 
 #define IBUFSZ 256
 
 struct tty {
-    struct file portdev; ///< File for wrapped port device: serial or screen
-    unsigned    flags;
+    struct list_head list;    ///< Entry in @ref ttys
+    unsigned         minor;   ///< Minor device number
+    struct file      portdev; ///< Wrapped port device: serial or screen
+    unsigned         flags;
 
-    unsigned initialized : 1; ///< Has TTY been initialized?
-    unsigned ibuf_eol    : 1; ///< Has input reached the end of a line?
-    unsigned ibuf_eof    : 1; ///< Has nput reached an EOF (or CTRL-D)?
+    unsigned ibuf_eol : 1; ///< Has input reached the end of a line?
+    unsigned ibuf_eof : 1; ///< Has nput reached an EOF (or CTRL-D)?
 
     size_t ilen;
     char   ibuf[IBUFSZ];
 };
 
-#define TTY_CT 2
-static struct tty ttys[TTY_CT] = {};
+static KMEM_CACHE(tty_cache, "tty", struct tty, NULL);
+static LIST_HEAD(ttys); ///< TTYs that have been opened, one per minor number
 
 #define SP_NONE    0x0000
 #define SP_ENDLINE 0x0001
@@ -38,16 +41,28 @@ struct specialchar {
 
 #define ISCOOKED(TTY) (TTY->flags & TTY_COOKED)
 
-static int tty_open_dev(struct file *file, unsigned min)
+static struct tty *tty_find(unsigned min)
 {
-    if (min > TTY_CT) return -ENODEV;
+    struct tty *tty;
+    list_for_each_entry(tty, &ttys, list)
+    {
+        if (tty->minor == min) return tty;
+    }
+    return NULL;
+}
 
-    /* Use static struct as file's device data. */
-    struct tty *tty     = &ttys[min];
-    file->f_driver_data = tty;
+static int tty_open_dev(struct file *file, unsigned min)
+{
+    /* If already initialzed, share the existing TTY. */
+    struct tty *tty = tty_find(min);
+    if (tty) {
+        file->f_driver_data = tty;
+        return 0;
+    }
 
-    /* If already initialzed, we're done. */
-    if (tty->initialized) return 0;
+    tty = kmem_cache_alloc(&tty_cache);
+    if (!tty) return -ENOMEM;
+    *tty = (struct tty){.minor = min};
 
     /*
      * Open inner port device based on minor number:
@@ -64,11 +79,14 @@ static int tty_open_dev(struct file *file, unsigned min)
         portres = file_open_dev(&tty->portdev, MAKEDEV(MAJ_SERIAL, min));
         log_result(portres, "init tty %d on serial %d\n", min, min);
     }
-    if (portres < 0) return portres;
+    if (portres < 0) {
+        kmem_cache_free(&tty_cache, tty);
+        return portres;
+    }
 
-    /* Continue initialization. */
-    tty->ilen        = 0;
-    tty->initialized = 1;
+    /* Use TTY struct as file's device data. */
+    list_add_tail(&tty->list, &ttys);
+    file->f_driver_data = tty;
     return 0;
 }
 
@@ -0,0 +1,357 @@
+// #define LOG_LEVEL LOG_DEBUG
+
+#include "cpio.h"
+
+#include <drivers/log.h>
+#include <drivers/vfs.h>
+
+#include <core/errno.h>
+#include <core/macros.h>
+#include <core/string.h>
+#include <core/types.h>
+
+#include <stdint.h>
+
+/** Log format wrapper with CPIO header info */
+#define CPIOH(HPTR, FMT) "%4lu %s\t" FMT, (HPTR)->hoff, (HPTR)->pathname
+
+/** @name CPIO value decoding */
+///@{
+
+/* SWAR byte-lane helpers. The comparisons set each lane's top bit if true,
+ * and only work for bytes below 0x80. */
+#define LANES(B)       (0x0101010101010101ull * (B)) ///< Byte B in every lane
+#define LANES_GE(X, B) (((X) + LANES(0x80 - (B))) & LANES(0x80))
+#define LANES_LE(X, B) (~((X) + LANES(0x7f - (B))) & LANES(0x80))
+
+/**
+ * Decode an 8-digit hex field, all digits at once
+ *
+ * The field is loaded as one 64-bit word, and all 8 characters are checked
+ * and converted in parallel, one per byte lane (SWAR: SIMD within a
+ * register). Each lane's comparisons are done by adding a bias and looking
+ * at the lane's top bit, which works as long as no byte has its top bit set
+ * to begin with. The nibbles are then packed together in three shift-and-mask
+ * steps. There are no per-character branches at all.
+ *
+ * Errors are not checked here: lanes that are not hex digits are ORed into
+ * *bad instead, so that a caller decoding many fields can check them all with
+ * a single branch at the end.
+ */
+static inline uint32_t hex8_decode(const char *field, uint64_t *bad)
+{
+    uint64_t x;
+    __builtin_memcpy(&x, field, 8); // One load. Little-endian: field[0] is
+                                    // the low byte.
+
+    /* Classify each byte: '0'-'9', or 'a'-'f' in either case. */
+    uint64_t lc    = x | LANES(0x20);
+    uint64_t digit = LANES_GE(x, '0') & LANES_LE(x, '9');
+    uint64_t alpha = LANES_GE(lc, 'a') & LANES_LE(lc, 'f');
+    *bad |= (x & LANES(0x80)) | ((digit | alpha) ^ LANES(0x80));
+
+    /* Convert to nibbles: low 4 bits, plus 9 for letters. */
+    x = (x & LANES(0x0f)) + (alpha >> 7) * 9;
+
+    /* Pack nibbles, most significant first. */
+    x = ((x << 4) | (x >> 8)) & 0x00ff00ff00ff00ffull;
+    x = ((x << 8) | (x >> 16)) & 0x0000ffff0000ffffull;
+    x = ((x << 16) | (x >> 32)) & 0x00000000ffffffffull;
+    return x;
+}
+
+/**
+ * Decode an 8-digit hex field, as in a "newc" header
+ *
+ * @returns 0 and sets *val, or -EINVAL if the field has a non-hex character
+ */
+int cpio_hex8(const char *field, uint32_t *val)
+{
+    uint64_t bad = 0;
+    *val         = hex8_decode(field, &bad);
+    if (bad) {
+        pr_error("%s: non-digit in header field \"%.8s\"\n", __func__, field);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+///@}
+
+/** @name CPIO header reading and decoding */
+///@{
+
+/** Check CPIO magic numbers and set header format */
+static int cpioh_check_magic(struct cpio_header *h, const char *magic)
+{
+    if (memcmp(magic, "070701", 6) == 0) {
+        pr_debug(CPIOH(h, "found newc magic \"%.6s\"\n"), magic);
+        h->fmt   = CF_NEWC;
+        h->hsize = sizeof(struct cpio_newc_header);
+        return 0;
+    }
+    pr_error(CPIOH(h, "not a known CPIO magic: \"%.6s\"\n"), magic);
+    return -EINVAL;
+}
+
+/**
+ * Check CPIO magic numbers and read in raw header data
+ *
+ * @pre     The file should be positioned at start of header.
+ * @post    Raw data will be read in and the @ref cpio_header.fmt field will
+ *          be set to indicate header type. The file will be positioned after
+ *          the header, ready to read in the pathname.
+ */
+static ssize_t cpio_read_header_raw(struct file *f, struct cpio_header *h)
+{
+    ssize_t ct = 0, res;
+
+    /* Reset header. */
+    *h = (struct cpio_header){.hoff = f->f_pos, .pathname = ""};
+
+    /* Read enough bytes to check ASCII magic numbers. */
+    ct += res = file_read(f, h->rawbuf.bytes, 6);
+    if (res < 0) return res;
+    if (res == 0) {
+        pr_error(CPIOH(h, "read past EOF\n"));
+        return -EINVAL;
+    }
+
+    /* Check ASCII magic numbers. */
+    res = cpioh_check_magic(h, h->rawbuf.bytes);
+    if (res < 0) return res;
+
+    /* Read rest of header. */
+    ct += res = file_read(f, h->rawbuf.bytes + ct, h->hsize - ct);
+    if (res < 0) return res;
+    h->newc = &h->rawbuf.newc;
+
+    return ct;
+}
+
+/** Decode header fields, and work out sizes */
+static int cpioh_decode(struct cpio_header *h)
+{
+    uint64_t bad = 0;
+    switch (h->fmt) {
+    case CF_NEWC:
+        h->nf.mode     = hex8_decode(h->newc->c_mode, &bad);
+        h->nf.filesize = hex8_decode(h->newc->c_filesize, &bad);
+        h->nf.devmajor = hex8_decode(h->newc->c_devmajor, &bad);
+        h->nf.devminor = hex8_decode(h->newc->c_devminor, &bad);
+        h->nf.namesize = hex8_decode(h->newc->c_namesize, &bad);
+        if (bad) {
+            pr_error(CPIOH(h, "non-digit in header fields\n"));
+            return -EINVAL;
+        }
+        h->psize = h->nf.namesize;
+        h->fsize = h->nf.filesize;
+        h->ppad  = ALIGN_UP(h->hsize + h->psize, 4) - (h->hsize + h->psize);
+        h->fpad  = ALIGN_UP(h->fsize, 4) - h->fsize;
+        return 0;
+    case CF_UNKNOWN: return -EINVAL;
+    };
+    return -EINVAL;
+}
+
+/** Convert CPIO mode field to @ref dirtype value */
+int cpio_mode_to_dirtype(unsigned mode)
+{
+    switch (mode & CM_FT_MASK) {
+    case 0: return DT_REG;
+    case CM_FT_DIR: return DT_DIR;
+    case CM_FT_CHR: return DT_CHR;
+    case CM_FT_BLK: return DT_CHR;
+    default: return -EINVAL;
+    };
+}
+
+/** Populate file struct with values from CPIO header */
+int cpioh_fstat(const struct cpio_header *h, struct fstat *fstat)
+{
+    switch (h->fmt) {
+    case CF_NEWC:
+        fstat->f_rdev = MAKEDEV(h->nf.devmajor, h->nf.devminor);
+        fstat->f_type = cpio_mode_to_dirtype(h->nf.mode);
+        fstat->f_size = h->fsize;
+        return 0;
+    case CF_UNKNOWN: return -EINVAL;
+    };
+    return -EINVAL;
+}
+
+/** Read the pathname that follows a CPIO header */
+static ssize_t cpio_read_pathname(struct file *f, struct cpio_header *h)
+{
+    ssize_t ct = 0, res;
+
+    /* Read pathname. */
+    ssize_t readsz = MIN(h->psize, sizeof(h->pathbuf));
+    while (ct < readsz) {
+        ct += res = file_read(f, h->pathbuf + ct, readsz - ct);
+        if (res < 0) return res;
+    }
+    if (h->psize > sizeof(h->pathbuf)) return -EOVERFLOW;
+    h->pathname = h->pathbuf;
+    pr_debug(CPIOH(h, "got pathname\n"));
+
+    /* Skip post-path padding. */
+    if (h->ppad != 0) {
+        res = file_lseek(f, h->ppad, SEEK_CUR);
+        if (res < 0) return res;
+        ct += h->ppad;
+    }
+
+    return ct;
+}
+
+/** Mark the header if it is the end-of-archive marker */
+static void cpioh_check_endmarker(struct cpio_header *h)
+{
+    if (h->fsize == 0 && strcmp(h->pathname, "TRAILER!!!") == 0) {
+        h->is_endmarker = 1;
+        pr_debug(CPIOH(h, "found end-of-archive marker\n"));
+    }
+}
+
+/**
+ * Decode a header in place, in archive memory
+ *
+ * @param   h       Header struct to fill in
+ * @param   p       Start of header in memory
+ * @param   avail   Number of bytes available from p
+ * @param   hoff    Offset of header in archive
+ * @returns size of header, pathname, and padding, or negative error code
+ */
+static ssize_t cpio_parse_header(
+        struct cpio_header *h, const char *p, size_t avail, loff_t hoff
+)
+{
+    int res;
+
+    *h = (struct cpio_header){.hoff = hoff, .pathname = ""};
+    if (avail < 6) {
+        pr_error(CPIOH(h, "read past EOF\n"));
+        return -EINVAL;
+    }
+    res = cpioh_check_magic(h, p);
+    if (res < 0) return res;
+    if (avail < h->hsize) return -EINVAL;
+    h->newc = (const struct cpio_newc_header *) p;
+
+    res = cpioh_decode(h);
+    if (res < 0) return res;
+    if (!h->psize || h->psize > avail - h->hsize) return -EINVAL;
+    h->pathname = p + h->hsize;
+    if (h->pathname[h->psize - 1] != '\0') return -EINVAL;
+    pr_debug(CPIOH(h, "got pathname\n"));
+
+    cpioh_check_endmarker(h);
+    return h->hsize + h->psize + h->ppad;
+}
+
+/**
+ * Full header read: read header, decode sizes, and read pathname
+ *
+ * If the archive is in memory, the header is decoded in place, without
+ * copying anything.
+ */
+ssize_t cpio_read_header(struct file *f, struct cpio_header *h)
+{
+    ssize_t ct = 0, res;
+
+    void *p;
+    res = file_direct_access(f, f->f_pos, SIZE_MAX, &p);
+    if (res != -ENOTSUP) {
+        if (res < 0) return res;
+        ct = res = cpio_parse_header(h, p, res, f->f_pos);
+        if (res < 0) return res;
+        res = file_lseek(f, ct, SEEK_CUR);
+        if (res < 0) return res;
+        return ct;
+    }
+
+    ct += res = cpio_read_header_raw(f, h);
+    if (res < 0) return res;
+
+    res = cpioh_decode(h);
+    if (res < 0) return res;
+
+    ct += res = cpio_read_pathname(f, h);
+    if (res < 0) return res;
+
+    cpioh_check_endmarker(h);
+    return ct;
+}
+
+/** Seek from beginning of file data to next header */
+ssize_t cpio_skip_fdata(struct file *f, struct cpio_header *h)
+{
+    return file_lseek(f, h->fsize + h->fpad, SEEK_CUR);
+}
+
+///@}
+
+/** @name CPIO searches */
+///@{
+
+int cpio_find_path(struct file *f, const char *p, struct cpio_header *h)
+{
+    int res;
+    *h = (struct cpio_header){};
+    pr_debug("find_path %s\n", p);
+    for (size_t i = 0; !h->is_endmarker; i++) {
+        res = cpio_read_header(f, h);
+        if (res < 0) return res;
+
+        if (strcmp(h->pathname, p) == 0) return i;
+
+        res = cpio_skip_fdata(f, h);
+        if (res < 0) return res;
+    }
+    return -ENOENT;
+}
+
+///@}
+
+/** @name CPIO path index */
+///@{
+
+/**
+ * Check an index member's data and set up a view of it.
+ *
+ * Only the layout is checked here, in constant time. Each entry's path
+ * offset is checked when the entry is looked at.
+ *
+ * @param   idx     View to fill in
+ * @param   data    Index data, must stay valid as long as the view is used
+ * @param   size    Size of data
+ * @returns 0 on success, or -EINVAL if the data is not a valid index
+ */
+int cpio_index_parse(struct cpio_index *idx, const void *data, size_t size)
+{
+    const struct cpio_index_hdr *hdr = data;
+    if (size < sizeof(*hdr)) return -EINVAL;
+    if (memcmp(hdr->magic, CPIO_INDEX_MAGIC, CPIO_INDEX_MAGICSZ) != 0)
+        return -EINVAL;
+
+    /* Entry table must fit before string table, and string table in data. */
+    size_t maxents = (size - sizeof(*hdr)) / sizeof(struct cpio_index_ent);
+    if (hdr->count > maxents) return -EINVAL;
+    size_t entsend = sizeof(*hdr) + hdr->count * sizeof(struct cpio_index_ent);
+    if (hdr->strtab < entsend || hdr->strtab > size) return -EINVAL;
+    if (!hdr->strsize || hdr->strsize > size - hdr->strtab) return -EINVAL;
+
+    const char *strtab = (const char *) data + hdr->strtab;
+    if (strtab[hdr->strsize - 1] != '\0') return -EINVAL;
+
+    *idx = (struct cpio_index){
+            .ents    = (const void *) (hdr + 1),
+            .strtab  = strtab,
+            .count   = hdr->count,
+            .strsize = hdr->strsize,
+    };
+    return 0;
+}
+
+///@}
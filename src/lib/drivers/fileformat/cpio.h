@@ -0,0 +1,136 @@
+/**
+ * @file
+ * CPIO archive format
+ *
+ * Header structs and decoding for the CPIO "newc" archive format, which we use
+ * for the initial ramdisk. The cpiofs filesystem driver is built on top of
+ * these.
+ */
+#ifndef FILEFORMAT_CPIO_H
+#define FILEFORMAT_CPIO_H
+
+#include "cpio_index.h"
+
+#include <drivers/vfs.h>
+
+#include <core/types.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @name CPIO mode field bits */
+///@{
+#define CM_FT_MASK 0060000
+#define CM_FT_DIR  0040000
+#define CM_FT_CHR  0020000
+#define CM_FT_BLK  0060000
+///@}
+
+enum cpio_format {
+    CF_UNKNOWN = 0,
+    CF_NEWC,
+};
+
+/**
+ * CPIO "New Character" format (aka "New ASCII") header struct
+ *
+ * - The magic number is the 6 characters "070701" (no terminator)
+ * - All other fields are encoded in ASCII as hexadecimal numbers
+ * - All fields are 8 characters (8 hex digits)
+ * - After path name, pad to 4-byte alignment
+ * - After file data, pad to 4-byte alignment
+ *
+ * @see
+ * - Arch Linux has a detailed man 5 page for the CPIO file format:
+ *      [cpio(5)](https://man.archlinux.org/man/cpio.5.en)
+ */
+struct cpio_newc_header {
+    char c_magic[6];
+    char c_ino[8];
+    char c_mode[8];
+    char c_uid[8];
+    char c_gid[8];
+    char c_nlink[8];
+    char c_mtime[8];
+    char c_filesize[8];
+    char c_devmajor[8];
+    char c_devminor[8];
+    char c_rdevmajor[8];
+    char c_rdevminor[8];
+    char c_namesize[8];
+    char c_check[8];
+};
+
+/**
+ * Decoded "newc" header fields
+ *
+ * Each header is decoded once, when it is read, so nothing needs to go back
+ * to the ASCII fields afterwards. Only the fields that we use are decoded.
+ */
+struct cpio_newc_fields {
+    uint32_t mode;     ///< File type and permissions
+    uint32_t filesize; ///< File size
+    uint32_t devmajor; ///< Device number, major part
+    uint32_t devminor; ///< Device number, minor part
+    uint32_t namesize; ///< Path length (including null terminator)
+};
+
+/**
+ * General CPIO header struct that can acommodate multiple formats
+ *
+ * If the archive is in memory (see @ref file_direct_access), the raw header
+ * and path name are used in place. Otherwise, they are read into buffers in
+ * this struct.
+ */
+struct cpio_header {
+    /** @name Raw header data */
+    ///@{
+    enum cpio_format               fmt;  ///< CPIO format type
+    const struct cpio_newc_header *newc; ///< Raw header as "newc" format.
+    struct cpio_newc_fields        nf;   ///< Decoded "newc" fields
+    ///@}
+
+    /** @name Important offsets and sizes */
+    ///@{
+    loff_t hoff;  ///< Start of CPIO header
+    size_t hsize; ///< Size of CPIO header
+    size_t psize; ///< Path length (including null terminator)
+    size_t ppad;  ///< Padding after pathname before file data
+    size_t fsize; ///< File size
+    size_t fpad;  ///< Padding after file data before next header
+    ///@}
+
+    /** @name Path name and results */
+    ///@{
+    const char *pathname;     ///< Path name
+    int         is_endmarker; ///< Is this header the "TRAILER!!" entry?
+    ///@}
+
+    /** @name Buffers, for archives that are not in memory */
+    ///@{
+    union {
+        struct cpio_newc_header newc; ///< Raw header as "newc" format.
+        char bytes[sizeof(struct cpio_newc_header)]; ///< Raw header as bytes.
+    } rawbuf;
+    char pathbuf[PATH_MAX]; ///< Copy of pathname
+    ///@}
+};
+
+/** Parsed view of a path index, see @ref cpio_index.h */
+struct cpio_index {
+    const struct cpio_index_ent *ents;    ///< Entries, in any order
+    const char                  *strtab;  ///< String table
+    size_t                       count;   ///< Number of entries
+    size_t                       strsize; ///< Size of string table
+};
+
+int     cpio_hex8(const char *field, uint32_t *val);
+int     cpio_mode_to_dirtype(unsigned mode);
+int     cpioh_fstat(const struct cpio_header *h, struct fstat *fstat);
+ssize_t cpio_read_header(struct file *f, struct cpio_header *h);
+ssize_t cpio_skip_fdata(struct file *f, struct cpio_header *h);
+int     cpio_find_path(struct file *f, const char *p, struct cpio_header *h);
+
+int cpio_index_parse(struct cpio_index *idx, const void *data, size_t size);
+
+#endif /* FILEFORMAT_CPIO_H */
@@ -0,0 +1,65 @@
+/**
+ * @file
+ * Path index for CPIO archives
+ *
+ * Finding a path in a plain CPIO archive means reading every header before
+ * it. To avoid that, the initrd build step (tools/cpio-index.c) puts an index
+ * member in front of the archive, named @ref CPIO_INDEX_NAME. Its file data
+ * is a table of all the other entries, with everything that cpiofs needs to
+ * build its directory tree without reading any other header:
+ *
+ * - @ref cpio_index_hdr
+ * - @ref cpio_index_ent, times @ref cpio_index_hdr.count
+ * - String table of null-terminated paths
+ *
+ * The tool writes entries in strcmp() order, so that each entry's parent
+ * directory is found at once while the tree is built, but readers must not
+ * depend on the order.
+ *
+ * All integers are little-endian, and all offsets are in bytes. Header
+ * offsets count from the start of the archive, i.e. from the index member's
+ * own header.
+ *
+ * The tool also puts a filler member, named @ref CPIO_PAD_NAME, in front of
+ * each regular file whose data would not start on a page boundary, so that
+ * executables can be mapped straight from the initrd. Readers skip fillers,
+ * and the index does not list them.
+ *
+ * An archive without an index is still a valid archive, and an archive with
+ * one is still a valid CPIO archive to any other tool.
+ *
+ * This header is shared with the host-side build tool, so it must not depend
+ * on anything but fixed-width integer types.
+ */
+#ifndef FILEFORMAT_CPIO_INDEX_H
+#define FILEFORMAT_CPIO_INDEX_H
+
+#include <stdint.h>
+
+#define CPIO_INDEX_NAME    ".cpio-index" ///< Path of the index member
+#define CPIO_INDEX_MAGIC   "CPIOIDX1"    ///< Magic number (8 bytes)
+#define CPIO_INDEX_MAGICSZ 8             ///< Size of magic number
+#define CPIO_PAD_NAME      ".cpio-pad"   ///< Path of filler members
+#define CPIO_PAD_ALIGN     4096          ///< Alignment of regular file data
+
+/** Index header, at the start of the index member's data */
+struct cpio_index_hdr {
+    char     magic[CPIO_INDEX_MAGICSZ]; ///< @ref CPIO_INDEX_MAGIC
+    uint32_t count;   ///< Number of entries
+    uint32_t strtab;  ///< Offset of string table from start of index data
+    uint32_t strsize; ///< Size of string table
+    uint32_t reserved;
+};
+
+/** Index entry for one archive member */
+struct cpio_index_ent {
+    uint32_t path;     ///< Offset of path in string table
+    uint32_t hoff;     ///< Offset of member's CPIO header in archive
+    uint32_t ino;      ///< Member number in archive (index member is 0)
+    uint32_t mode;     ///< CPIO mode field
+    uint32_t fsize;    ///< File size
+    uint32_t devmajor; ///< CPIO devmajor field
+    uint32_t devminor; ///< CPIO devminor field
+};
+
+#endif /* FILEFORMAT_CPIO_INDEX_H */
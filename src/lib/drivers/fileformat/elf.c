@@ -7,6 +7,9 @@
 #include <core/inttypes.h>
 #include <core/macros.h>
 #include <core/sprintf.h>
+#include <core/string.h>
+
+#define ELF_DEBUGSTR_MAX 144 ///< Fits the longest ident or phdr description
 
 static int
 e_ident_tostr(char *dst, size_t n, const unsigned char e_ident[EI_NIDENT])
@@ -90,21 +93,22 @@ static int elf_phdr32_tostr(char *dst, size_t n, Elf32_Phdr *phdr)
 int elf_read_ehdr32(struct file *f, Elf32_Ehdr *ehdr)
 {
     int  res;
-    char debugbuf[PATH_MAX];
+    char debugbuf[ELF_DEBUGSTR_MAX];
 
     res = file_read(f, ehdr, sizeof(Elf32_Ehdr));
     if (res < 0) return res;
 
     if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0) return -EINVAL;
     pr_info("ELF %s\n",
-            (e_ident_tostr(debugbuf, PATH_MAX, ehdr->e_ident), debugbuf));
+            (e_ident_tostr(debugbuf, sizeof(debugbuf), ehdr->e_ident),
+             debugbuf));
 
     res = ehdr->e_ident[EI_CLASS] == ELFCLASS32 ? 0 : -ENOTSUP;
     if (res < 0) return res;
     res = ehdr->e_type == ET_EXEC ? 0 : -ENOTSUP;
     if (res < 0) return res;
 
-    pr_info("entry point %#8zx\n", ehdr->e_entry);
+    pr_info("entry point %#8x\n", ehdr->e_entry);
     pr_info("%u segments, entry size %u bytes\n", ehdr->e_phnum,
             ehdr->e_phentsize);
 
@@ -116,7 +120,7 @@ int elf_read_phdr32(
 )
 {
     int  res;
-    char debugbuf[PATH_MAX];
+    char debugbuf[ELF_DEBUGSTR_MAX];
 
     res = file_lseek(f, ehdr->e_phoff + i * sizeof(Elf32_Phdr), SEEK_SET);
     if (res < 0) return res;
@@ -124,15 +128,51 @@ int elf_read_phdr32(
     if (res < 0) return res;
 
     pr_info("seg %zu: %s\n", i,
-            (elf_phdr32_tostr(debugbuf, PATH_MAX, phdr), debugbuf));
+            (elf_phdr32_tostr(debugbuf, sizeof(debugbuf), phdr), debugbuf));
 
     return 0;
 }
 
-int elf_load_seg32(struct file *f, Elf32_Phdr *phdr)
+/**
+ * Read part of a loadable segment's memory image.
+ *
+ * Fills in the bytes of the segment that fall inside [va, va + n). Bytes
+ * backed by the file are read from it, and the rest of the segment (bss) is
+ * zeroed. Bytes of dst that are outside the segment are left alone, so
+ * several segments that share a page can be read into the same buffer.
+ *
+ * @param   f       ELF file
+ * @param   phdr    Program header of the segment
+ * @param   va      Virtual address that dst corresponds to
+ * @param   n       Size of dst
+ * @param   dst     Destination buffer
+ * @returns 0 on success, or
+ *          - -ENOEXEC if the file ends before the segment's file data
+ *          - other negative error code if the read fails
+ */
+int elf_read_seg32(
+        struct file *f, const Elf32_Phdr *phdr, uintptr_t va, size_t n,
+        void *dst
+)
 {
-    UNUSED(f), UNUSED(phdr);
-    TODO();
-    return -ENOTSUP;
-}
+    uintptr_t seg_start = phdr->p_vaddr;
+    uintptr_t seg_file  = seg_start + phdr->p_filesz;
+    uintptr_t seg_end   = seg_start + phdr->p_memsz;
+    uintptr_t lo        = MAX(va, seg_start);
+    uintptr_t hi        = MIN(va + n, seg_end);
+    if (lo >= hi) return 0;
+
+    /* File-backed part. */
+    uintptr_t fhi = MIN(hi, seg_file);
+    if (lo < fhi) {
+        loff_t  off = phdr->p_offset + (lo - seg_start);
+        ssize_t res = file_pread(f, (char *) dst + (lo - va), fhi - lo, off);
+        if (res < 0) return res;
+        if ((size_t) res != fhi - lo) return -ENOEXEC;
+    }
 
+    /* Zero-filled part. */
+    uintptr_t zlo = MAX(lo, seg_file);
+    if (zlo < hi) memset((char *) dst + (zlo - va), 0, hi - zlo);
+    return 0;
+}
@@ -5,10 +5,16 @@
 
 #include <drivers/vfs.h>
 
+#include <stddef.h>
+#include <stdint.h>
+
 int elf_read_ehdr32(struct file *f, Elf32_Ehdr *ehdr);
 int elf_read_phdr32(
         struct file *f, Elf32_Ehdr *ehdr, size_t i, Elf32_Phdr *phdr
 );
-int elf_load_seg32(struct file *f, Elf32_Phdr *phdr);
+int elf_read_seg32(
+        struct file *f, const Elf32_Phdr *phdr, uintptr_t va, size_t n,
+        void *dst
+);
 
 #endif /* FILEFORMAT_ELF_H */
@@ -1,453 +1,485 @@
 // #define LOG_LEVEL LOG_DEBUG
 
 #include <drivers/devices.h>
+#include <drivers/fileformat/cpio.h>
 #include <drivers/log.h>
 #include <drivers/vfs.h>
 
-#include <core/ctype.h>
 #include <core/errno.h>
+#include <core/list.h>
 #include <core/macros.h>
-#include <core/path.h>
+#include <core/slab.h>
 #include <core/sprintf.h>
 #include <core/string.h>
 #include <core/types.h>
 
-#include <stdint.h>
+#include <stdbool.h>
 
-/** @name CPIO mode field bits */
+/** @name CPIOfs directory tree */
 ///@{
-#define CM_FT_MASK 0060000
-#define CM_FT_DIR  0040000
-#define CM_FT_CHR  0020000
-#define CM_FT_BLK  0060000
-///@}
-
-enum cpio_format {
-    CF_UNKNOWN = 0,
-    CF_NEWC,
-};
 
 /**
- * CPIO "New Character" format (aka "New ASCII") header struct
+ * Node in the in-memory directory tree
  *
- * - The magic number is the 6 characters "070701" (no terminator)
- * - All other fields are encoded in ASCII as hexadecimal numbers
- * - All fields are 8 characters (8 hex digits)
- * - After path name, pad to 4-byte alignment
- * - After file data, pad to 4-byte alignment
- *
- * @see
- * - Arch Linux has a detailed man 5 page for the CPIO file format:
- *      [cpio(5)](https://man.archlinux.org/man/cpio.5.en)
+ * The tree is built once, at mount time, so that lookups and directory
+ * listings never have to go back to the archive's headers.
  */
-struct cpio_newc_header {
-    char c_magic[6];
-    char c_ino[8];
-    char c_mode[8];
-    char c_uid[8];
-    char c_gid[8];
-    char c_nlink[8];
-    char c_mtime[8];
-    char c_filesize[8];
-    char c_devmajor[8];
-    char c_devminor[8];
-    char c_rdevmajor[8];
-    char c_rdevminor[8];
-    char c_namesize[8];
-    char c_check[8];
+struct cnode {
+    struct list_head sibling;  ///< Entry in parent's list of children
+    struct list_head children; ///< Child nodes, in archive order
+    struct cnode    *parent;   ///< Parent directory (root is its own parent)
+    char            *name;     ///< Last path component
+    struct fstat     st;       ///< Metadata from CPIO header
+    loff_t           foff;     ///< Offset of file data in archive
 };
 
-/** General CPIO header struct that can acommodate multiple formats */
-struct cpio_header {
-    /** Raw header data */
-    ///@{
-    enum cpio_format fmt; ///< CPIO format type
-    union {
-        struct cpio_newc_header newc; ///< Raw header as "newc" format.
-        char bytes[sizeof(struct cpio_newc_header)]; ///< Raw header as bytes.
-    };
-    ///@}
-
-    /** @name Important offsets and sizes */
-    ///@{
-    loff_t hoff;  ///< Start of CPIO header
-    size_t hsize; ///< Size of CPIO header
-    size_t psize; ///< Path length (including null terminator)
-    size_t ppad;  ///< Padding after pathname before file data
-    size_t fsize; ///< File size
-    size_t fpad;  ///< Padding after file data before next header
-    ///@}
-
-    /** @name Path name and results */
-    ///@{
-    char pathname[PATH_MAX]; ///< Copy of pathname
-    int  is_endmarker;       ///< Is this header the "TRAILER!!" entry?
-    ///@}
-};
-
-/** Log format wrapper with CPIO header info */
-#define CPIOH(HPTR, FMT) "%4lu %s\t" FMT, (HPTR)->hoff, (HPTR)->pathname
-
-/** @name CPIO value decoding */
-///@{
+static KMEM_CACHE(cnode_cache, "cpio_node", struct cnode, NULL);
 
-static long cpio_atoi(const char *field, size_t n, int base)
+static struct cnode *
+cnode_create(struct cnode *parent, const char *name, size_t len)
 {
-    int ret = 0;
-    for (const char *pos = field; n; pos++, n--) {
-        int  digit;
-        char c = tolower(*pos);
-        if ('0' <= c && c <= '9') digit = c - '0' + 0x0;
-        else if ('a' <= c && c <= 'f') digit = c - 'a' + 0xa;
-        else {
-            pr_error("%s: non-digit '%c' in header field\n", __func__, c);
-            return -EINVAL;
-        }
-        if (digit >= base) {
-            pr_error("%s: digit %x >= base %u\n", __func__, digit, base);
-            return -EINVAL;
-        }
-        ret = ret * base + digit;
+    struct cnode *n = kmem_cache_alloc(&cnode_cache);
+    if (!n) return NULL;
+    *n = (struct cnode){
+            .parent = parent ? parent : n,
+            .name   = kmalloc(len + 1),
+            .st     = {.f_type = DT_DIR}, // Until a header says otherwise.
+    };
+    if (!n->name) {
+        kmem_cache_free(&cnode_cache, n);
+        return NULL;
     }
-    return ret;
+    memcpy(n->name, name, len);
+    n->name[len] = '\0';
+    INIT_LIST_HEAD(&n->children);
+    INIT_LIST_HEAD(&n->sibling);
+    if (parent) list_add_tail(&n->sibling, &parent->children);
+    return n;
 }
 
-static long newc_atoi(const char *field) { return cpio_atoi(field, 8, 16); }
-
-///@}
-
-/** @name CPIO header reading and decoding */
-///@{
+static void cnode_destroy(struct cnode *n)
+{
+    struct cnode *child, *tmp;
+    list_for_each_entry_safe(child, tmp, &n->children, sibling)
+    {
+        cnode_destroy(child);
+    }
+    list_del(&n->sibling);
+    kfree(n->name);
+    kmem_cache_free(&cnode_cache, n);
+}
 
 /**
- * Check CPIO magic numbers and read in raw header data
+ * Find a directory's child by name
  *
- * @pre     The file should be positioned at start of header.
- * @post    Raw data will be read in and the @ref cpio_header.fmt field will
- *          be set to indicate header type. The file will be positioned after
- *          the header, ready to read in the pathname.
+ * Searches from the most recently added child. Archives are sorted, so while
+ * the tree is being built, the parent of each new entry is found at once.
  */
-static ssize_t cpio_read_header_raw(struct file *f, struct cpio_header *h)
+static struct cnode *
+cnode_child(struct cnode *dir, const char *name, size_t len)
 {
-    ssize_t ct = 0, res;
-
-    /* Reset header. */
-    *h = (struct cpio_header){.hoff = f->f_pos};
-
-    /* Read enough bytes to check ASCII magic numbers. */
-    ct += res = file_read(f, h->bytes, 6);
-    if (res < 0) return res;
-    if (res == 0) {
-        pr_error(CPIOH(h, "read past EOF\n"));
-        return -EINVAL;
-    }
-
-    /* Check ASCII magic numbers. */
-    if (memcmp(h->bytes, "070701", 6) == 0) {
-        pr_debug(CPIOH(h, "found newc magic \"%.6s\"\n"), h->newc.c_magic);
-        h->fmt   = CF_NEWC;
-        h->hsize = sizeof(struct cpio_newc_header);
-    } else {
-        pr_error(CPIOH(h, "not a known CPIO magic: \"%.6s\"\n"), h->bytes);
-        return -EINVAL;
+    struct cnode *n;
+    list_for_each_entry_prev(n, &dir->children, sibling)
+    {
+        if (strncmp(n->name, name, len) == 0 && !n->name[len]) return n;
     }
-
-    /* Read rest of header. */
-    ct += res = file_read(f, h->bytes + ct, h->hsize - ct);
-    if (res < 0) return res;
-
-    return ct;
+    return NULL;
 }
 
-/** Decode important size fields in header */
-static int cpioh_decode_sizes(struct cpio_header *h)
+/**
+ * Walk a relative path from a directory, one component at a time
+ *
+ * Empty and "." components are skipped, and ".." goes to the parent.
+ *
+ * @param   dir     Starting directory
+ * @param   path    Relative path
+ * @param   create  Create missing nodes (as directories)
+ * @returns node at end of path, or NULL if it does not exist (or could not
+ *          be created)
+ */
+static struct cnode *
+cnode_walk(struct cnode *dir, const char *path, bool create)
 {
-    switch (h->fmt) {
-    case CF_NEWC:
-        h->psize = newc_atoi(h->newc.c_namesize);
-        h->fsize = newc_atoi(h->newc.c_filesize);
-        h->ppad  = ALIGN_UP(h->hsize + h->psize, 4) - (h->hsize + h->psize);
-        h->fpad  = ALIGN_UP(h->fsize, 4) - h->fsize;
-        return 0;
-    case CF_UNKNOWN: return -EINVAL;
-    };
-    return -EINVAL;
+    struct cnode *n = dir;
+    while (*path) {
+        const char *end = strchr(path, '/');
+        if (!end) end = path + strlen(path);
+        size_t len = end - path;
+
+        if (len == 0 || (len == 1 && path[0] == '.')) {
+            /* Stay. */
+        } else if (len == 2 && path[0] == '.' && path[1] == '.') {
+            n = n->parent;
+        } else {
+            if (n->st.f_type != DT_DIR) return NULL;
+            struct cnode *child = cnode_child(n, path, len);
+            if (!child && create) child = cnode_create(n, path, len);
+            if (!child) return NULL;
+            n = child;
+        }
+        path = *end ? end + 1 : end;
+    }
+    return n;
 }
 
-/** Convert CPIO mode field to @ref dirtype value */
-static int cpio_mode_to_dirtype(unsigned mode)
-{
-    switch (mode & CM_FT_MASK) {
-    case 0: return DT_REG;
-    case CM_FT_DIR: return DT_DIR;
-    case CM_FT_CHR: return DT_CHR;
-    case CM_FT_BLK: return DT_CHR;
-    default: return -EINVAL;
-    };
-}
+///@}
+
+/** @name CPIOfs driver data for superblocks */
+///@{
 
-/** Populate file struct with values from CPIO header */
-static int cpioh_fstat(const struct cpio_header *h, struct fstat *fstat)
+struct cpio_sb {
+    struct file   af;     ///< Archive file, shared by all open files
+    struct cnode *root;   ///< Root of directory tree
+    size_t        nnodes; ///< Number of archive members in the tree
+    ino_t         maxino; ///< Highest inode number in the tree
+};
+
+/** Add an archive member to the directory tree */
+static int cpio_sb_add(
+        struct cpio_sb     *csb,
+        const char         *path,
+        const struct fstat *st,
+        loff_t              foff
+)
 {
-    unsigned mode;
-    switch (h->fmt) {
-    case CF_NEWC:
-        fstat->f_rdev =
-                MAKEDEV(newc_atoi(h->newc.c_devmajor),
-                        newc_atoi(h->newc.c_devminor));
-
-        mode          = newc_atoi(h->newc.c_mode);
-        fstat->f_type = cpio_mode_to_dirtype(mode);
-        fstat->f_size = h->fsize;
-        return 0;
-    case CF_UNKNOWN: return -EINVAL;
-    };
-    return -EINVAL;
+    if (strcmp(path, CPIO_INDEX_NAME) == 0) return 0;
+    if (strcmp(path, CPIO_PAD_NAME) == 0) return 0;
+    struct cnode *n = cnode_walk(csb->root, path, true);
+    if (!n) return -ENOMEM;
+    n->st   = *st;
+    n->foff = foff;
+    csb->nnodes++;
+    if (st->f_ino > csb->maxino) csb->maxino = st->f_ino;
+    return 0;
 }
 
-/** Read the pathname that follows a CPIO header */
-static ssize_t cpio_read_pathname(struct file *f, struct cpio_header *h)
+/**
+ * Give inode numbers to directories that have no archive member of their own
+ *
+ * Archive members are numbered from 1, so 0 means "not numbered yet".
+ */
+static void cpio_sb_number(struct cpio_sb *csb, struct cnode *n)
 {
-    ssize_t ct = 0, res;
-
-    /* Read pathname. */
-    ssize_t readsz = MIN(h->psize, sizeof(h->pathname));
-    while (ct < readsz) {
-        ct += res = file_read(f, h->pathname + ct, readsz - ct);
-        if (res < 0) return res;
+    if (!n->st.f_ino) n->st.f_ino = ++csb->maxino;
+    struct cnode *child;
+    list_for_each_entry(child, &n->children, sibling)
+    {
+        cpio_sb_number(csb, child);
     }
-    if (h->psize > sizeof(h->pathname)) return -EOVERFLOW;
-    pr_debug(CPIOH(h, "got pathname\n"));
-
-    /* Skip post-path padding. */
-    if (h->ppad != 0) {
-        res = file_lseek(f, h->ppad, SEEK_CUR);
-        if (res < 0) return res;
-        ct += h->ppad;
-    }
-
-    return ct;
 }
 
-/** Full header read: read header, decode sizes, and read pathname */
-static ssize_t cpio_read_header(struct file *f, struct cpio_header *h)
+/**
+ * Build the directory tree from the archive's path index
+ *
+ * The index has all the metadata that the tree needs, so no other headers
+ * have to be read at all. The whole index is checked before anything is
+ * added to the tree.
+ *
+ * @returns 0 on success, -ENOENT if the archive has no (valid) index, or
+ *          other negative error code
+ */
+static int cpio_sb_build_from_index(struct cpio_sb *csb, struct file *af)
 {
-    ssize_t ct = 0, res;
+    int               res;
+    struct cpio_index idx;
+    void             *idxdata, *idxbuf = NULL;
 
-    ct += res = cpio_read_header_raw(f, h);
-    if (res < 0) return res;
+    struct cpio_header *h = kmalloc(sizeof(*h));
+    res                   = h ? 0 : -ENOMEM;
+    if (res < 0) goto exit;
 
-    res = cpioh_decode_sizes(h);
-    if (res < 0) return res;
+    /* The index is the first member, if it is there. */
+    res = cpio_read_header(af, h);
+    if (res < 0) goto exit;
+    res = strcmp(h->pathname, CPIO_INDEX_NAME) == 0 ? 0 : -ENOENT;
+    if (res < 0) goto exit;
 
-    ct += res = cpio_read_pathname(f, h);
-    if (res < 0) return res;
+    /* Use the index in place if the archive is in memory, else copy it. */
+    res = file_direct_access(af, af->f_pos, h->fsize, &idxdata);
+    if (res < 0 && res != -ENOTSUP) goto exit;
+    if ((size_t) res != h->fsize
+        || !IS_ALIGNED((uintptr_t) idxdata, alignof(struct cpio_index_ent))) {
+        idxdata = idxbuf = kmalloc(h->fsize);
+        res              = idxbuf ? 0 : -ENOMEM;
+        if (res < 0) goto exit;
+        res = file_read(af, idxbuf, h->fsize);
+        if (res < 0) goto exit;
+        res = (size_t) res == h->fsize ? 0 : -ENOENT;
+        if (res < 0) goto exit;
+    }
+    res = cpio_index_parse(&idx, idxdata, h->fsize) < 0 ? -ENOENT : 0;
+    if (res < 0) goto exit;
 
-    if (h->fsize == 0
-        && strncmp(h->pathname, "TRAILER!!!", sizeof(h->pathname)) == 0) {
-        h->is_endmarker = 1;
-        pr_debug(CPIOH(h, "found end-of-archive marker\n"));
+    for (size_t i = 0; i < idx.count; i++) {
+        res = idx.ents[i].path < idx.strsize ? 0 : -ENOENT;
+        if (res < 0) goto exit;
     }
 
-    return ct;
-}
+    for (size_t i = 0; i < idx.count; i++) {
+        const struct cpio_index_ent *e     = &idx.ents[i];
+        const char                  *path  = idx.strtab + e->path;
+        size_t                       psize = strlen(path) + 1;
+        struct fstat                 st    = {
+                                   .f_ino  = e->ino,
+                                   .f_type = cpio_mode_to_dirtype(e->mode),
+                                   .f_rdev = MAKEDEV(e->devmajor, e->devminor),
+                                   .f_size = e->fsize,
+        };
+        loff_t foff = e->hoff + ALIGN_UP(h->hsize + psize, 4);
+        res         = cpio_sb_add(csb, path, &st, foff);
+        if (res < 0) goto exit;
+    }
 
-/** Seek from beginning of file data to next header */
-static ssize_t cpio_skip_fdata(struct file *f, struct cpio_header *h)
-{
-    return file_lseek(f, h->fsize + h->fpad, SEEK_CUR);
+exit:
+    kfree(idxbuf);
+    kfree(h);
+    return res;
 }
 
-///@}
-
-/** @name CPIO searches */
-///@{
-
-static int cpio_find_path(struct file *f, const char *p, struct cpio_header *h)
+/** Build the directory tree in one pass over the archive's headers */
+static int cpio_sb_build_from_scan(struct cpio_sb *csb, struct file *af)
 {
     int res;
-    *h = (struct cpio_header){};
-    pr_debug("find_path %s\n", p);
-    for (size_t i = 0; !h->is_endmarker; i++) {
-        res = cpio_read_header(f, h);
-        if (res < 0) return res;
 
-        if (strcmp(h->pathname, p) == 0) return i;
-
-        res = cpio_skip_fdata(f, h);
-        if (res < 0) return res;
+    struct cpio_header *h = kmalloc(sizeof(*h));
+    if (!h) return -ENOMEM;
+    for (ino_t ino = 1;; ino++) {
+        res = cpio_read_header(af, h);
+        if (res < 0 || h->is_endmarker) break;
+
+        struct fstat st;
+        res = cpioh_fstat(h, &st);
+        if (res < 0) break;
+        st.f_ino    = ino;
+        loff_t foff = h->hoff + h->hsize + h->psize + h->ppad;
+        res         = cpio_sb_add(csb, h->pathname, &st, foff);
+        if (res < 0) break;
+
+        res = cpio_skip_fdata(af, h);
+        if (res < 0) break;
     }
-    return -ENOENT;
+    kfree(h);
+    return res < 0 ? res : 0;
 }
 
 ///@}
 
-/** @name CPIOfs driver data for files */
+/** @name CPIOfs Operations */
 ///@{
 
-struct cfdata {
-    struct file        af;   ///< Archive file.
-    struct cpio_header h;    ///< Header for target file.
-    loff_t             foff; ///< Offset of target file inside archive file.
-};
-
-#define MAX_CPIO_OPEN 4
-static struct cfdata cfdatas[MAX_CPIO_OPEN];
+static int cpio_sb_release(struct superblock *sb)
+{
+    struct cpio_sb *csb = sb->s_driver_data;
+    if (!csb) return 0;
+    if (csb->root) cnode_destroy(csb->root);
+    file_close(&csb->af);
+    kfree(csb);
+    sb->s_driver_data = NULL;
+    return 0;
+}
 
-static struct cfdata *cfdata_alloc(void)
+/** Get the shared inode for a tree node */
+static struct inode *cpio_iget(struct superblock *sb, struct cnode *node)
 {
-    for (size_t i = 0; i < ARRAY_SIZE(cfdatas); i++) {
-        struct cfdata *cfdata = cfdatas + i;
-        if (!cfdata->af.f_op) return cfdata;
+    struct inode *inode = iget(sb, node->st.f_ino);
+    if (inode && inode->i_state & I_NEW) {
+        inode->i_stat    = node->st;
+        inode->i_private = node;
+        inode->i_state &= ~I_NEW;
     }
-    return NULL;
+    return inode;
 }
 
-static void cfdata_free(struct cfdata *cfdata) { cfdata->af.f_op = NULL; }
-
-///@}
-
-/** @name CPIOfs Operations */
-///@{
-
+/**
+ * Mount: build the directory tree
+ *
+ * Uses the archive's path index if it has one, and otherwise reads each
+ * header once.
+ */
 static int cpio_sb_open(struct superblock *sb)
 {
     int res;
 
-    struct file af; // Archive File
-    res = file_open_dev(&af, sb->s_bdev);
-    if (res < 0) return res;
-
-    file_debugstr(sb->s_name, sizeof(sb->s_name), &af);
-
-    /* Find root inode. */
-    struct cpio_header h = {};
-    sb->s_root_ino = res = cpio_find_path(&af, ".", &h);
-    debug_result(res, "find root dir: header #%u\n", sb->s_root_ino);
-    if (res < 0) goto close_and_return;
-
-close_and_return:
-    file_close(&af);
-    return res;
-}
-
-static int
-cpio_file_open_path(struct file *f, struct superblock *sb, const char *path)
-{
-    int res, isopen_af = 0;
-    if (!*path) path = ".";
-
-    /* Allocate a CPIO file data structure. */
-    struct cfdata *cfdata = cfdata_alloc();
-    res                   = cfdata ? 0 : -ENOMEM;
-    if (!cfdata) goto exit;
+    struct cpio_sb *csb = sb->s_driver_data = kzalloc(sizeof(*csb));
+    if (!csb) return -ENOMEM;
 
-    /* Open the archive file. */
-    res = file_open_dev(&cfdata->af, sb->s_bdev);
+    /* Keep the archive file open for as long as we are mounted. */
+    res = file_open_dev(&csb->af, sb->s_bdev);
     if (res < 0) goto exit;
-    isopen_af = 1;
 
-    /* Search for the desired path. */
-    res = cpio_find_path(&cfdata->af, path, &cfdata->h);
+    file_debugstr(sb->s_name, sizeof(sb->s_name), &csb->af);
+
+    csb->root = cnode_create(NULL, "", 0);
+    res       = csb->root ? 0 : -ENOMEM;
     if (res < 0) goto exit;
 
-    /* Copy metadata fields. */
-    res = cpioh_fstat(&cfdata->h, &f->f_stat);
+    /* Build tree, from the index if there is one. */
+    res = cpio_sb_build_from_index(csb, &csb->af);
+    if (res == -ENOENT) {
+        res = file_lseek(&csb->af, 0, SEEK_SET);
+        if (res < 0) goto exit;
+        res = cpio_sb_build_from_scan(csb, &csb->af);
+    }
+    debug_result(res, "build directory tree: %zu nodes\n", csb->nnodes);
     if (res < 0) goto exit;
+    cpio_sb_number(csb, csb->root);
 
-    /* Finish file setup. */
-    cfdata->foff = cfdata->h.hoff + cfdata->h.hsize + cfdata->h.psize
-                   + cfdata->h.ppad;
-    f->f_driver_data = cfdata;
+    sb->s_root_ino      = csb->root->st.f_ino;
+    sb->s_root->d_inode = cpio_iget(sb, csb->root);
+    res                 = sb->s_root->d_inode ? 0 : -ENOMEM;
 
-    res = 0;
 exit:
-    if (res < 0) {
-        if (cfdata && isopen_af) file_close(&cfdata->af);
-        if (cfdata) cfdata_free(cfdata);
-    }
+    if (res < 0) cpio_sb_release(sb);
     return res;
 }
 
-static int cpio_file_release(struct file *f)
+/** Look up a name in a directory's tree node */
+static int cpio_file_lookup(struct dentry *dir, struct dentry *d)
+{
+    struct cnode *node = cnode_child(
+            dir->d_inode->i_private, d->d_name, d->d_namelen
+    );
+    if (!node) return -ENOENT;
+    d->d_inode = cpio_iget(d->d_sb, node);
+    return d->d_inode ? 0 : -ENOMEM;
+}
+
+/**
+ * Get the child after n in a directory listing
+ *
+ * Directory positions are child indices. The cursor, kept in f_driver_data,
+ * is the child at f_pos, or NULL at the end.
+ */
+static struct cnode *cpio_dir_next(struct cnode *dir, struct cnode *n)
+{
+    if (!n || list_is_last(&n->sibling, &dir->children)) return NULL;
+    return list_next_entry(n, sibling);
+}
+
+/** Get the child at a position in a directory listing */
+static struct cnode *cpio_dir_seek(struct cnode *dir, loff_t pos)
+{
+    if (pos < 0 || list_empty(&dir->children)) return NULL;
+    struct cnode *n = list_first_entry(&dir->children, struct cnode, sibling);
+    for (; n && pos; pos--) n = cpio_dir_next(dir, n);
+    return n;
+}
+
+/**
+ * Open a file
+ *
+ * Everything about the file is in its shared inode, so the only per-open
+ * state is the readdir cursor: the next child node, kept in f_driver_data.
+ */
+static int cpio_file_open_dentry(struct file *f, struct dentry *d)
 {
-    if (f->f_driver_data) cfdata_free(f->f_driver_data);
+    f->f_driver_data = cpio_dir_seek(d->d_inode->i_private, 0);
     return 0;
 }
 
 static ssize_t
 cpio_file_read(struct file *f, void *dst, size_t count, loff_t *off)
 {
-    struct cfdata *cfdata = f->f_driver_data;
+    struct cpio_sb *csb  = f->f_inode->i_sb->s_driver_data;
+    struct cnode   *node = f->f_inode->i_private;
 
     /* Get target offset within archive file. */
-    loff_t aoff = *off + cfdata->foff;
+    loff_t aoff = *off + node->foff;
 
     /* Don't read archive file past end of target file. */
+    if (*off < 0 || *off >= f->f_stat.f_size) return 0;
     if (*off + (loff_t) count > f->f_stat.f_size)
-        count = f->f_stat.f_size - f->f_pos;
+        count = f->f_stat.f_size - *off;
 
-    /* Read target file within archive file. */
-    int res = file_pread(&cfdata->af, dst, count, aoff);
+    /* Read target file within archive file, straight from memory if we can. */
+    void   *src;
+    ssize_t res = file_direct_access(&csb->af, aoff, count, &src);
+    if (res >= 0) memcpy(dst, src, res);
+    else if (res == -ENOTSUP) res = file_pread(&csb->af, dst, count, aoff);
     if (res < 0) return res;
     aoff += res;
 
     /* Set resulting offset. */
-    *off = aoff - cfdata->foff;
+    *off = aoff - node->foff;
 
     return res;
 }
 
+/** Read the next entry of a directory (direct children only) */
 static int cpio_file_readdir(struct file *f, struct dirent *d)
 {
-    int res;
+    struct cnode *n = f->f_driver_data;
+    if (!n) return 0;
 
-    struct cfdata *cfdata  = f->f_driver_data;
-    const char    *dirpath = cfdata->h.pathname;
-    if (strcmp(dirpath, ".") == 0) dirpath = "";
-    int dirpathlen = strlen(dirpath);
+    d->d_ino  = n->st.f_ino;
+    d->d_type = n->st.f_type;
+    snprintf(d->d_name, PATH_MAX, "%s", n->name);
 
-    /* If the archive was just opened, the position should be just after
-     * the directory's own header. Skip to the next header. */
-    if (f->f_pos == 0) {
-        res = cpio_skip_fdata(&cfdata->af, &cfdata->h);
-        if (res < 0) return res;
-    }
+    f->f_driver_data = cpio_dir_next(f->f_inode->i_private, n);
+    f->f_pos++;
+    return 1;
+}
 
-    /* Read entries from archive file starting at current position,
-     * looking for an entry whos path begins with the directory's path. */
-    struct cpio_header h = {};
-    for (;;) {
-        res = cpio_read_header(&cfdata->af, &h);
-        if (res < 0) return res;
-        res = cpio_skip_fdata(&cfdata->af, &h);
-        if (res < 0) return res;
-
-        if (h.is_endmarker) return 0;
-        if (strncmp(h.pathname, dirpath, dirpathlen) == 0) break;
+/** Read as many entries of a directory as fit, straight from the tree */
+static ssize_t cpio_file_getdents(struct file *f, void *buf, size_t len)
+{
+    struct cnode *dir = f->f_inode->i_private;
+    struct cnode *n   = f->f_driver_data;
+    char         *pos = buf;
+
+    for (; n; n = cpio_dir_next(dir, n), f->f_pos++) {
+        size_t reclen = dirent_rec_pack(
+                pos, len - (pos - (char *) buf), n->st.f_ino, f->f_pos + 1,
+                n->st.f_type, n->name, strlen(n->name)
+        );
+        if (!reclen) break;
+        pos += reclen;
     }
+    f->f_driver_data = n;
+
+    if (n && pos == buf) return -EINVAL; // Buffer too small for one entry.
+    return pos - (char *) buf;
+}
 
-    struct fstat fstat;
-    cpioh_fstat(&h, &fstat);
-    d->d_ino  = fstat.f_ino;
-    d->d_type = fstat.f_type;
+/** Seek: in a directory, move the readdir cursor to match */
+static loff_t cpio_file_lseek(struct file *f, loff_t off, int whence)
+{
+    if (f->f_stat.f_type != DT_DIR) return 0;
+    switch (whence) {
+    case SEEK_SET: break;
+    case SEEK_CUR: off += f->f_pos; break;
+    default: return -EINVAL;
+    }
+    f->f_driver_data = cpio_dir_seek(f->f_inode->i_private, off);
+    return 0;
+}
 
-    const char *relpath = path_strip_prefix(h.pathname, dirpath);
-    snprintf(d->d_name, PATH_MAX, "%s", relpath);
-    return 1;
+static int cpio_file_phys_addr(
+        struct file *f, loff_t off, size_t len, uintptr_t *paddr
+)
+{
+    struct cpio_sb *csb  = f->f_inode->i_sb->s_driver_data;
+    struct cnode   *node = f->f_inode->i_private;
+    if (off < 0 || off > f->f_stat.f_size) return -EINVAL;
+    if (len > (size_t) (f->f_stat.f_size - off)) return -EINVAL;
+    return file_phys_addr(&csb->af, node->foff + off, len, paddr);
 }
 
 static const struct file_operations cpio_file_ops = {
-        .name      = "cpio_file",
-        .open_path = cpio_file_open_path,
-        .release   = cpio_file_release,
-        .read      = cpio_file_read,
-        .readdir   = cpio_file_readdir,
+        .name        = "cpio_file",
+        .lookup      = cpio_file_lookup,
+        .open_dentry = cpio_file_open_dentry,
+        .read        = cpio_file_read,
+        .readdir     = cpio_file_readdir,
+        .getdents    = cpio_file_getdents,
+        .lseek       = cpio_file_lseek,
+        .phys_addr   = cpio_file_phys_addr,
 };
 
 static const struct fs_operations cpio_fs_ops = {
         .name        = "cpiofs",
         .sb_open     = cpio_sb_open,
+        .sb_release  = cpio_sb_release,
         .fs_file_ops = &cpio_file_ops,
 };
 
@@ -2,12 +2,17 @@
 
 #include <drivers/vfs.h>
 
+#include <core/clock.h>
 #include <core/compiler.h>
 #include <core/errno.h>
 #include <core/macros.h>
 #include <core/sprintf.h>
+#include <core/string.h>
 
-#define DEFAULT_BUFSZ 256
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ERRSTR_BUFSZ 64 ///< Buffer size for error names
 
 static struct file *log_file = NULL;
 
@@ -30,69 +35,170 @@ int log_set_file(struct file *file)
     return res;
 }
 
-static int log_vsnprintf(
-        char                    *buf,
-        size_t                   n,
+/** Format the part of a log line that comes before the message */
+static int log_fmt_head(
+        struct fmtstream        *fs,
+        uint64_t                 stamp,
         enum log_level           lvl,
         const char              *prefix,
-        const struct _log_extra *x,
-        const char              *fmt,
-        va_list                  va
+        const struct _log_extra *x
 )
 {
-    int   res;
-    char *pos = buf, *end = buf + n;
+    int res;
+
+    /* Format timestamp. */
+    uint64_t ns = clock_ticks_to_ns(stamp);
+    res         = fmtstream_printf(
+            fs, "[%5lu.%06lu] ", (unsigned long) (ns / NSEC_PER_SEC),
+            (unsigned long) (ns % NSEC_PER_SEC / NSEC_PER_USEC)
+    );
+    if (res < 0) return res;
 
     /* Format level string. */
-    pos += res = snprintf(pos, BUFREM(pos, end), "%-7s: ", LVLSTRS[lvl]);
+    res = fmtstream_printf(fs, "%-7s: ", LVLSTRS[lvl]);
     if (res < 0) return res;
 
     /* Format result. */
     if (x && x->result) {
         if (*x->result == 0) {
-            pos += res = snprintf(pos, BUFREM(pos, end), "[OK] ");
+            res = fmtstream_printf(fs, "[OK] ");
         } else if (*x->result <= 0) {
-            char errbuf[DEFAULT_BUFSZ];
-            strerror_s(errbuf, DEFAULT_BUFSZ, -*x->result);
-            pos += res = snprintf(pos, BUFREM(pos, end), "[-%s] ", errbuf);
+            char errbuf[ERRSTR_BUFSZ];
+            strerror_s(errbuf, ERRSTR_BUFSZ, -*x->result);
+            res = fmtstream_printf(fs, "[-%s] ", errbuf);
         } else {
-            pos += res = snprintf(pos, BUFREM(pos, end), "[%d] ", *x->result);
+            res = fmtstream_printf(fs, "[%d] ", *x->result);
         }
         if (res < 0) return res;
     }
 
     /* Format prefix. */
-    pos += res = snprintf(pos, BUFREM(pos, end), "%s: ", prefix);
+    res = fmtstream_printf(fs, "%s: ", prefix);
     if (res < 0) return res;
 
     /* Format value name. */
     if (x && x->valname) {
-        pos += res = snprintf(
-                pos, BUFREM(pos, end), "%-*s: ", x->tblhw, x->valname
-        );
+        res = fmtstream_printf(fs, "%-*s: ", x->tblhw, x->valname);
         if (res < 0) return res;
     }
 
-    /* Format message. */
-    pos += res = vsnprintf(pos, BUFREM(pos, end), fmt, va);
-    if (res < 0) return res;
+    return 0;
+}
+
+/** Format the part of a log line that comes after the message */
+static int log_fmt_tail(struct fmtstream *fs, const struct _log_extra *x)
+{
+    int res;
 
     /* Format decoded value. */
     if (x && x->valdecode) {
-        pos += res = snprintf(pos, BUFREM(pos, end), " (%s)", x->valdecode);
+        res = fmtstream_printf(fs, " (%s)", x->valdecode);
         if (res < 0) return res;
     }
 
     /* Format postfix. */
     if (x && x->postfix) {
-        pos += res = snprintf(pos, BUFREM(pos, end), "%s", x->postfix);
+        res = fmtstream_printf(fs, "%s", x->postfix);
         if (res < 0) return res;
     }
 
-    return pos - buf;
+    return 0;
 }
 
-int _vlogf(
+/**
+ * @name Log ring buffer and deferred (binary) logging
+ *
+ * In deferred mode (the default), a log call does not format anything. It
+ * records the format string pointer, the call-site info, and the raw
+ * arguments (see @ref vfmtpack) in a ring buffer, and returns. The records
+ * are rendered to text and written to the log file later, by @ref log_flush,
+ * which the kernel calls at quiet moments, e.g. while the shell is idle.
+ *
+ * Flushed records stay in the ring until they are overwritten by new ones,
+ * so the most recent history can be shown again by @ref log_dump.
+ *
+ * Error-level records are flushed right away, so that they are not lost if
+ * the system goes down before the next flush.
+ */
+///@{
+
+#ifndef LOG_RING_SZ
+#define LOG_RING_SZ (16 * 1024) ///< Size of log record ring buffer
+#endif
+#define LOG_REC_MAX 256         ///< Max size of a single deferred record
+
+#define LR_RESULT 0x01 ///< Record has a result value
+#define LR_DECODE 0x02 ///< Record has a decoded value string
+
+/**
+ * Deferred log record header
+ *
+ * Followed by the packed message args, and then the decoded value string
+ * (if any). Strings in the header are all literals from the call site.
+ */
+struct log_rec {
+    unsigned short size;    ///< Size of whole record, in bytes
+    unsigned short pkglen;  ///< Size of packed message args
+    unsigned char  lvl;     ///< Log level
+    unsigned char  flags;   ///< Which optional fields are present (LR_*)
+    unsigned short tblhw;   ///< Table head width for value name
+    int            result;  ///< Result value (if LR_RESULT)
+    uint64_t       stamp;   ///< Clock reading when the record was made
+    const char    *prefix;  ///< Log prefix (usually file name)
+    const char    *fmt;     ///< Message format string
+    const char    *postfix; ///< Postfix string (or NULL)
+    const char    *valname; ///< Value name (or NULL)
+};
+
+static bool   log_deferred = true;  ///< Deferred mode on/off
+static char   log_ring[LOG_RING_SZ]; ///< Ring buffer for log records
+static size_t log_head     = 0;      ///< Ring write offset (only increases)
+static size_t log_tail     = 0;      ///< Next record to flush
+static size_t log_first    = 0;      ///< Oldest record still in ring
+static bool   log_flushing = false;  ///< Guard against flushing from a flush
+
+/** Copy into the ring at a given offset, wrapping around the end */
+static void ring_put(size_t off, const void *src, size_t n)
+{
+    size_t pos   = off % LOG_RING_SZ;
+    size_t first = MIN(n, LOG_RING_SZ - pos);
+    memcpy(&log_ring[pos], src, first);
+    memcpy(log_ring, (const char *) src + first, n - first);
+}
+
+/** Copy out of the ring at a given offset, wrapping around the end */
+static void ring_get(size_t off, void *dst, size_t n)
+{
+    size_t pos   = off % LOG_RING_SZ;
+    size_t first = MIN(n, LOG_RING_SZ - pos);
+    memcpy(dst, &log_ring[pos], first);
+    memcpy((char *) dst + first, log_ring, n - first);
+}
+
+/** Render one deferred record to text */
+static int log_render(struct fmtstream *fs, const char *rec)
+{
+    struct log_rec h;
+    memcpy(&h, rec, sizeof(h));
+
+    const char       *pkg = rec + sizeof(h);
+    struct _log_extra x   = {
+              .result    = h.flags & LR_RESULT ? &h.result : NULL,
+              .postfix   = h.postfix,
+              .valname   = h.valname,
+              .tblhw     = h.tblhw,
+              .valdecode = h.flags & LR_DECODE ? pkg + h.pkglen : NULL,
+    };
+
+    int res = log_fmt_head(fs, h.stamp, h.lvl, h.prefix, &x);
+    if (res < 0) return res;
+    res = fmtstream_pkprintf(fs, h.fmt, pkg, h.pkglen);
+    if (res < 0) return res;
+    return log_fmt_tail(fs, &x);
+}
+
+/** Record a log message in the ring, without formatting it */
+static int log_defer(
         enum log_level           lvl,
         const char              *prefix,
         const struct _log_extra *x,
@@ -100,33 +206,211 @@ int _vlogf(
         va_list                  va
 )
 {
-    if (lvl < 0 || LOG_DEBUG < lvl) return -EINVAL;
+    char           rec[LOG_REC_MAX];
+    struct log_rec h = {
+            .lvl     = lvl,
+            .stamp   = clock_read(),
+            .tblhw   = x ? x->tblhw : 0,
+            .prefix  = prefix,
+            .fmt     = fmt,
+            .postfix = x ? x->postfix : NULL,
+            .valname = x ? x->valname : NULL,
+    };
+    if (x && x->result) h.flags |= LR_RESULT, h.result = *x->result;
+
+    /* Pack message args. */
+    size_t size = sizeof(h);
+    int    res  = vfmtpack(rec + size, LOG_REC_MAX - size, fmt, va);
+    if (res < 0) return res;
+    h.pkglen = res;
+    size += res;
+    if (size > LOG_REC_MAX) return -ENOBUFS;
+
+    /* Copy decoded value string, which may be in a temporary buffer. */
+    if (x && x->valdecode) {
+        size_t len = strlen(x->valdecode) + 1;
+        if (size + len > LOG_REC_MAX) return -ENOBUFS;
+        memcpy(rec + size, x->valdecode, len);
+        h.flags |= LR_DECODE;
+        size += len;
+    }
+
+    h.size = size;
+    memcpy(rec, &h, sizeof(h));
+
+    /* Make room in the ring by dropping the oldest records. If the oldest
+     * has not been flushed yet, flush first (or lose it if we can't). */
+    while (LOG_RING_SZ - (log_head - log_first) < size) {
+        if (log_first == log_tail) log_flush();
+
+        struct log_rec old;
+        ring_get(log_first, &old, sizeof(old));
+        if (log_tail == log_first) log_tail += old.size;
+        log_first += old.size;
+    }
+
+    ring_put(log_head, rec, size);
+    log_head += size;
+
+    if (lvl == LOG_ERROR && log_file) log_flush();
+    return 0;
+}
+
+int log_set_deferred(bool deferred)
+{
+    log_deferred = deferred;
+    if (!deferred) return log_flush();
+    return 0;
+}
+
+/**
+ * Render records from a ring offset up to the head, advancing the offset
+ *
+ * Rendering can cause more logging (e.g. from the output driver), which can
+ * overwrite old records. If that happens, skip ahead to the oldest record.
+ */
+static int log_render_to_head(struct fmtstream *fs, size_t *off)
+{
+    for (;;) {
+        if (*off < log_first) *off = log_first;
+        if (*off == log_head) return 0;
+
+        char           rec[LOG_REC_MAX];
+        struct log_rec h;
+        ring_get(*off, &h, sizeof(h));
+        ring_get(*off, rec, h.size);
+        *off += h.size;
+
+        int res = log_render(fs, rec);
+        if (res < 0) return res;
+    }
+}
+
+int log_flush(void)
+{
+    if (log_tail == log_head) return 0;
     if (!log_file) return -EBADF;
+    if (log_flushing) return -EBUSY; // E.g. the log file's driver logging.
 
-    int bufsz = DEFAULT_BUFSZ;
-try_format : {
-    char buf[bufsz];
+    /* Render all records into one stream, so that the log file gets
+     * full-size writes instead of one per record. */
+    int              res;
+    struct fmtstream fs;
+    fmtstream_init(&fs, file_fmt_sink, log_file);
+    log_flushing = true;
+    res          = log_render_to_head(&fs, &log_tail);
+    if (res >= 0) res = fmtstream_flush(&fs);
+    log_flushing = false;
+    return res;
+}
 
-    /* Format message. */
-    va_list va_tmp;
-    va_copy(va_tmp, va);
-    int res = log_vsnprintf(buf, bufsz, lvl, prefix, x, fmt, va);
-    va_end(va_tmp);
+int log_dump(struct file *f)
+{
+    /* Render everything still in the ring, flushed or not. */
+    int              res;
+    size_t           off = log_first;
+    struct fmtstream fs;
+    fmtstream_init(&fs, file_fmt_sink, f);
+    res = log_render_to_head(&fs, &off);
     if (res < 0) return res;
+    return fmtstream_flush(&fs);
+}
+
+///@}
 
-    /* If the formatted output was too big for the buffer,
-     * try again with a buffer that is the correct size. */
-    if (res >= bufsz) {
-        bufsz = res + 1;
-        goto try_format;
+int _vlogf(
+        enum log_level           lvl,
+        const char              *prefix,
+        const struct _log_extra *x,
+        const char              *fmt,
+        va_list                  va
+)
+{
+    if (lvl < 0 || LOG_DEBUG < lvl) return -EINVAL;
+
+    /* Deferred mode: record now, format later. Records that are too big
+     * fall back to being formatted right away, after any pending ones. */
+    if (log_deferred) {
+        int res = log_defer(lvl, prefix, x, fmt, va);
+        if (res != -ENOBUFS) return res;
+        log_flush();
     }
 
-    /* If formatting was successful, write to log file. */
-    res = file_write(log_file, buf, res);
-    return res;
+    if (!log_file) return -EBADF;
+
+    /* Format the whole line once, streaming it to the log file in chunks. */
+    struct fmtstream fs;
+    fmtstream_init(&fs, file_fmt_sink, log_file);
+    int res = log_fmt_head(&fs, clock_read(), lvl, prefix, x);
+    if (res < 0) return res;
+    res = fmtstream_vprintf(&fs, fmt, va);
+    if (res < 0) return res;
+    res = log_fmt_tail(&fs, x);
+    if (res < 0) return res;
+    return fmtstream_flush(&fs);
+}
+
+/**
+ * @name Runtime log levels
+ *
+ * All log call sites are in one linker section. The linker defines the
+ * `__start_` and `__stop_` symbols for it, so it can be walked as an array.
+ */
+///@{
+
+extern struct log_site __start_log_sites[], __stop_log_sites[];
+
+/** Check if a site belongs to a module, with or without the ".c" */
+static bool site_in_module(const struct log_site *site, const char *module)
+{
+    size_t len = strlen(module);
+    if (strncmp(site->module, module, len) != 0) return false;
+    return !site->module[len] || strcmp(&site->module[len], ".c") == 0;
+}
+
+int log_parse_level(const char *name)
+{
+    for (int lvl = LOG_ERROR; lvl <= LOG_DEBUG; lvl++)
+        if (strcmp(name, LVLSTRS[lvl]) == 0) return lvl;
+    if ('0' <= name[0] && name[0] <= '0' + LOG_DEBUG && !name[1])
+        return name[0] - '0';
+    return -EINVAL;
 }
+
+int log_set_level(const char *module, enum log_level lvl)
+{
+    if (lvl < LOG_ERROR || LOG_DEBUG < lvl) return -EINVAL;
+
+    bool all   = strcmp(module, "all") == 0;
+    int  count = 0;
+    for (struct log_site *site = __start_log_sites; site < __stop_log_sites;
+         site++) {
+        if (!all && !site_in_module(site, module)) continue;
+        site->level = lvl;
+        count++;
+    }
+    return count ? count : -ENOENT;
+}
+
+int log_print_levels(struct file *f)
+{
+    struct log_site *start = __start_log_sites, *end = __stop_log_sites;
+    for (struct log_site *site = start; site < end; site++) {
+        /* Only print the first site of each module. */
+        struct log_site *prev = start;
+        while (prev < site && strcmp(prev->module, site->module)) prev++;
+        if (prev < site) continue;
+
+        int res = file_printf(
+                f, "%-16s %s\n", site->module, LVLSTRS[site->level]
+        );
+        if (res < 0) return res;
+    }
+    return 0;
 }
 
+///@}
+
 ATTR_PRINTFLIKE(4, 5)
 int _logf(
         enum log_level           lvl,
@@ -15,8 +15,8 @@
 #include <core/string.h>
 
 #include <stdatomic.h>
-#include <limits.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 /**
@@ -58,6 +58,9 @@ enum log_level {
  * If the module is not set when the header is included, then the header
  * will set it to a default level.
  *
+ * This is only the starting level. Every log call site is compiled in, and
+ * the level can be changed at runtime with @ref log_set_level.
+ *
  * - When compiling for our OS, the default is @ref LOG_INFO.
  * - When compiling for another OS, such as Linux, the default level is
  *      @ref LOG_ERROR. This is to reduce log output noise during unit testing.
@@ -75,9 +78,40 @@ enum log_level {
 #define LOG_PREFIX ""
 #endif
 
+/**
+ * Log call site descriptor
+ *
+ * Every log macro call site gets one of these in the @ref LOG_SITE_SECTION
+ * linker section, so that the levels of all sites in a module can be found
+ * and changed at runtime. A call site that is disabled costs one compare and
+ * a predictable branch.
+ *
+ * Aligned to its own size, so that the linker section is a plain array.
+ */
+struct log_site {
+    const char *module; ///< Module name (@ref LOG_PREFIX)
+    int         level;  ///< Most verbose level that is enabled at this site
+} ATTR_ALIGNED(2 * sizeof(void *));
+
+#define LOG_SITE_SECTION "log_sites" ///< Linker section for log call sites
+
+/** Define a log call site descriptor for the current call site */
+#define LOG_SITE(NAME) \
+    static struct log_site NAME ATTR_SECTION(LOG_SITE_SECTION) = { \
+            .module = LOG_PREFIX, \
+            .level  = LOG_LEVEL, \
+    }
+
 struct file;
 
 int log_set_file(struct file *file);
+int log_set_deferred(bool deferred);
+int log_flush(void);
+int log_dump(struct file *f);
+
+int log_parse_level(const char *name);
+int log_set_level(const char *module, enum log_level lvl);
+int log_print_levels(struct file *f);
 
 struct _log_extra {
     const int  *result;
@@ -99,7 +133,8 @@ int _logf(
 
 #define logf(LVL, FMT, ...) \
     do { \
-        if (LOG_LEVEL >= LVL) \
+        LOG_SITE(_site); \
+        if (LVL <= _site.level) \
             _logf(LVL, LOG_PREFIX, NULL, FMT, ##__VA_ARGS__); \
     } while (0)
 
@@ -110,10 +145,10 @@ int _logf(
 
 #define log_result(RES, FMT, ...) \
     do { \
-        if ((RES < 0 && LOG_LEVEL >= LOG_WARN) \
-            || (RES >= 0 && LOG_LEVEL >= LOG_INFO)) { \
-            enum log_level    _lvl  = RES < 0 ? LOG_WARN : LOG_INFO; \
-            int               _res  = RES; \
+        LOG_SITE(_site); \
+        int            _res = RES; \
+        int            _lvl = _res < 0 ? LOG_WARN : LOG_INFO; \
+        if (_lvl <= _site.level) { \
             struct _log_extra extra = {.result = &_res}; \
             _logf(_lvl, LOG_PREFIX, &extra, FMT, ##__VA_ARGS__); \
         } \
@@ -121,12 +156,11 @@ int _logf(
 
 #define debug_result(RES, FMT, ...) \
     do { \
-        if ((RES < 0 && LOG_LEVEL >= LOG_DEBUG) \
-            || (RES >= 0 && LOG_LEVEL >= LOG_DEBUG)) { \
-            enum log_level    _lvl  = RES < 0 ? LOG_DEBUG : LOG_DEBUG; \
+        LOG_SITE(_site); \
+        if (LOG_DEBUG <= _site.level) { \
             int               _res  = RES; \
             struct _log_extra extra = {.result = &_res}; \
-            _logf(_lvl, LOG_PREFIX, &extra, FMT, ##__VA_ARGS__); \
+            _logf(LOG_DEBUG, LOG_PREFIX, &extra, FMT, ##__VA_ARGS__); \
         } \
     } while (0)
 
@@ -136,7 +170,8 @@ int _logf(
 
 #define log_val(LVL, VAL, fmt) \
     do { \
-        if (LOG_LEVEL >= LVL) { \
+        LOG_SITE(_site); \
+        if (LVL <= _site.level) { \
             struct _log_extra extra = { \
                     .valname = #VAL, \
                     .tblhw   = LOG_TABLE_HEAD_WIDTH, \
@@ -148,7 +183,8 @@ int _logf(
 
 #define log_val_decode(LVL, VAL, fmt, decode) \
     do { \
-        if (LOG_LEVEL >= LVL) { \
+        LOG_SITE(_site); \
+        if (LVL <= _site.level) { \
             struct _log_extra extra = { \
                     .valname   = #VAL, \
                     .tblhw     = LOG_TABLE_HEAD_WIDTH, \
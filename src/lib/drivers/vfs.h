@@ -30,6 +30,19 @@ struct dirent {
     char          d_name[PATH_MAX];
 };
 
+/**
+ * Variable-length directory entry, as packed by file_getdents()
+ *
+ * Records follow each other in the buffer, each @ref d_reclen bytes long.
+ */
+struct dirent_rec {
+    ino_t          d_ino;
+    loff_t         d_off;    ///< Cookie: position of the next entry
+    unsigned short d_reclen; ///< Length of this record, including padding
+    unsigned char  d_type;
+    char           d_name[]; ///< Null-terminated name
+};
+
 struct superblock {
     /** @name On-disk or filesystem-intrinsic data */
     ///@{
@@ -41,7 +54,9 @@ struct superblock {
     dev_t s_bdev;               ///< Device number of the FS's block device
     char  s_name[DEBUGSTR_MAX]; ///< String description of superblock
     char  s_mountpath[PATH_MAX];
-    struct list_head s_mount_list;
+    struct dentry   *s_root;     ///< Cached root directory entry
+    struct list_head s_dentries; ///< Other cached entries, see @ref dentry
+    unsigned         s_ninodes;  ///< In-core inodes, see iget()
     ///@}
 
     /** @name Driver polymorphism */
@@ -59,8 +74,94 @@ struct fstat {
     loff_t       f_size;
 };
 
+/** @name Inode states */
+///@{
+#define I_NEW 0x1 ///< Just created by iget(), needs filling in
+///@}
+
+/**
+ * In-core inode: one shared object per file per superblock
+ *
+ * Looked up by (superblock, inode number) in a hash table, see iget(), and
+ * shared by every dentry and open file that refers to the same file.
+ */
+struct inode {
+    /** @name Key */
+    ///@{
+    struct superblock *i_sb;  ///< Owning superblock
+    ino_t              i_ino; ///< Inode number, unique within superblock
+    ///@}
+
+    /** @name Metadata from disk */
+    ///@{
+    struct fstat i_stat;
+    ///@}
+
+    /** @name Live data */
+    ///@{
+    unsigned         i_state; ///< Inode state bits, e.g. @ref I_NEW
+    unsigned         i_count; ///< Reference count
+    struct list_head i_hash;  ///< Entry in inode hash bucket
+    ///@}
+
+    /** @name Driver polymorphism */
+    ///@{
+    void *i_private; ///< Driver's own data for the file
+    ///@}
+};
+
+/**
+ * Directory entry cache entry
+ *
+ * Caches the result of looking up one path component in one directory, so
+ * that the next lookup of the same path does not need the filesystem driver.
+ * Negative entries remember names that do not exist.
+ *
+ * Entries are keyed by (parent entry, name). Each superblock has its own root
+ * entry, which is never evicted.
+ */
+struct dentry {
+    /** @name Key */
+    ///@{
+    struct dentry *d_parent;  ///< Parent directory (root is its own parent)
+    char          *d_name;    ///< Last path component
+    size_t         d_namelen; ///< Length of name
+    uint32_t       d_hashval; ///< Hash of parent and name
+    ///@}
+
+    /** @name Cached lookup result */
+    ///@{
+    struct inode *d_inode; ///< The file, or NULL if the name does not exist
+    ///@}
+
+    /** @name Cache bookkeeping */
+    ///@{
+    struct superblock *d_sb;        ///< Owning superblock
+    struct list_head   d_hash;      ///< Entry in hash bucket
+    struct list_head   d_lru;       ///< Entry in least-recently-used list
+    struct list_head   d_sb_list;   ///< Entry in superblock's list
+    unsigned           d_nchildren; ///< Number of cached children
+    unsigned           d_count;     ///< References from path handles
+    ///@}
+};
+
+struct mount_node;
+
+/**
+ * Handle for a place in the VFS namespace, e.g. a working directory
+ *
+ * Paths can be resolved relative to a handle without walking from the root
+ * again, see vfs_path_lookup() and file_openat().
+ */
+struct vfs_path {
+    struct superblock *sb;     ///< Filesystem (NULL if none is mounted here)
+    struct dentry     *dentry; ///< Directory entry (NULL if none)
+    struct mount_node *mnode;  ///< Nearest mount trie node at or above
+    unsigned           mdepth; ///< Number of components below mnode
+};
+
 struct file {
-    /** @name Metadata from disk (inode data) */
+    /** @name Metadata from disk (copy of inode data) */
     ///@{
     struct fstat f_stat;
     ///@}
@@ -82,6 +183,8 @@ struct fs_operations {
     const char *name;
     int (*sb_open)(struct superblock *sb);
     int (*sb_release)(struct superblock *sb);
+    /** Free driver data for an inode, when the last reference is dropped */
+    void (*evict_inode)(struct inode *inode);
     const struct file_operations *fs_file_ops;
 };
 
@@ -89,31 +192,71 @@ struct file_operations {
     const char *name;
     int (*open_dev)(struct file *f, unsigned min);
 
-    int (*stat_path
-    )(struct fstat *fstat, struct superblock *sb, const char *relpath);
-    int (*open_path
-    )(struct file *f, struct superblock *sb, const char *relpath);
+    /**
+     * Look up d->d_name in directory dir
+     *
+     * Should set d->d_inode (see iget()), or return -ENOENT if the name does
+     * not exist. Results are cached in the dentry cache.
+     */
+    int (*lookup)(struct dentry *dir, struct dentry *d);
+    /** Open a file that has been looked up */
+    int (*open_dentry)(struct file *f, struct dentry *d);
 
     int (*release)(struct file *f);
 
     int (*debugstr)(char *descbuf, size_t n, struct file *f);
     ssize_t (*read)(struct file *f, void *dst, size_t count, loff_t *off);
     int (*readdir)(struct file *f, struct dirent *d);
+    /** Pack as many directory entries as fit, see dirent_rec_pack() */
+    ssize_t (*getdents)(struct file *f, void *buf, size_t len);
 
     ssize_t (*write
     )(struct file *f, const void *src, size_t count, loff_t *off);
     loff_t (*lseek)(struct file *f, loff_t off, int whence);
 
     int (*ioctl)(struct file *f, unsigned cmd, uintptr_t arg);
+
+    /** Get pointer to contents at off, for up to len bytes, if in memory */
+    ssize_t (*direct_access
+    )(struct file *f, loff_t off, size_t len, void **kaddr);
+
+    /** Get physical address of [off, off + len), if it is contiguous RAM */
+    int (*phys_addr
+    )(struct file *f, loff_t off, size_t len, uintptr_t *paddr);
 };
 
-extern struct list_head vfs_mount_list;
+/** Callback for vfs_mount_foreach() */
+typedef int vfs_mount_fn(struct superblock *sb, void *ctx);
 
 int fs_register(unsigned fstypeid, const struct fs_operations *ops);
 int fs_mountdev(dev_t blockdev, unsigned fstypeid, const char *mpath);
+int fs_umount(const char *mpath);
+int vfs_mount_foreach(vfs_mount_fn *fn, void *ctx);
 
 int chrdev_register(unsigned maj, const struct file_operations *fops);
 
+struct inode *iget(struct superblock *sb, ino_t ino);
+struct inode *igrab(struct inode *inode);
+void          iput(struct inode *inode);
+
+int  dcache_init_sb(struct superblock *sb);
+void dcache_invalidate_sb(struct superblock *sb);
+void dcache_release_sb(struct superblock *sb);
+int dcache_lookup(
+        struct dentry *dir, const char *name, size_t len, struct dentry **dp
+);
+
+struct dentry *dget(struct dentry *d);
+void           dput(struct dentry *d);
+
+void vfs_path_root(struct vfs_path *p);
+void vfs_path_get(struct vfs_path *p);
+void vfs_path_put(struct vfs_path *p);
+int  vfs_path_name(char *buf, size_t n, const struct vfs_path *p);
+int vfs_path_lookup(
+        struct vfs_path *res, const struct vfs_path *start, const char *path
+);
+
 int     file_stat(struct fstat *fstat, const char *cwd, const char *path);
 int     file_open_dev(struct file *file, dev_t rdev);
 int     file_open_path(struct file *file, const char *cwd, const char *path);
@@ -121,16 +264,40 @@ int     file_close(struct file *file);
 ssize_t file_read(struct file *f, void *dst, size_t count);
 ssize_t file_pread(struct file *f, void *dst, size_t count, loff_t off);
 int     file_readdir(struct file *f, struct dirent *d);
+ssize_t file_getdents(struct file *f, void *buf, size_t len);
 int     file_debugstr(char *descbuf, size_t n, struct file *f);
 ssize_t file_write(struct file *f, const void *src, size_t count);
 ssize_t file_pwrite(struct file *f, const void *src, size_t count, loff_t off);
 loff_t  file_lseek(struct file *f, loff_t off, int whence);
 int     file_ioctl(struct file *f, unsigned cmd, uintptr_t arg);
 
+size_t dirent_rec_pack(
+        void          *buf,
+        size_t         len,
+        ino_t          ino,
+        loff_t         off,
+        unsigned char  type,
+        const char    *name,
+        size_t         namelen
+);
+
+int file_statat(
+        struct fstat *fstat, const struct vfs_path *dir, const char *path
+);
+int file_openat(
+        struct file *file, const struct vfs_path *dir, const char *path
+);
+
 int file_readstr(struct file *f, char *dst, size_t n);
+int file_phys_addr(struct file *f, loff_t off, size_t len, uintptr_t *paddr);
+ssize_t
+file_direct_access(struct file *f, loff_t off, size_t len, void **kaddr);
 
 ATTR_PRINTFLIKE(2, 3)
 int file_printf(struct file *f, const char *fmt, ...);
 int file_vprintf(struct file *f, const char *fmt, va_list va);
 
+/** Format sink that writes each chunk to a file (ctx is a `struct file *`) */
+int file_fmt_sink(void *ctx, const char *buf, size_t n);
+
 #endif /* VFS_H */
@@ -0,0 +1,242 @@
+// #define LOG_LEVEL LOG_DEBUG
+
+#include "vfs.h"
+
+#include <drivers/log.h>
+
+#include <core/errno.h>
+#include <core/list.h>
+#include <core/slab.h>
+#include <core/string.h>
+
+/** @name Dentry cache parameters */
+///@{
+#define DCACHE_BUCKETS 256  ///< Number of hash buckets (power of two)
+#define DCACHE_MAX     1024 ///< Number of entries to keep, besides roots
+///@}
+
+/** @name Dentry allocation */
+///@{
+
+static KMEM_CACHE(dentry_cache, "dentry", struct dentry, NULL);
+
+static struct list_head dcache_hash[DCACHE_BUCKETS];
+static LIST_HEAD(dcache_lru); ///< All non-root entries, most recent first
+static size_t dcache_count;   ///< Number of non-root entries
+
+static struct dentry *d_alloc(
+        struct superblock *sb,
+        struct dentry     *parent,
+        const char        *name,
+        size_t             len,
+        uint32_t           hashval
+)
+{
+    struct dentry *d = kmem_cache_alloc(&dentry_cache);
+    if (!d) return NULL;
+    *d = (struct dentry){
+            .d_parent  = parent ? parent : d,
+            .d_name    = kmalloc(len + 1),
+            .d_namelen = len,
+            .d_hashval = hashval,
+            .d_sb      = sb,
+    };
+    if (!d->d_name) {
+        kmem_cache_free(&dentry_cache, d);
+        return NULL;
+    }
+    memcpy(d->d_name, name, len);
+    d->d_name[len] = '\0';
+    INIT_LIST_HEAD(&d->d_hash);
+    INIT_LIST_HEAD(&d->d_lru);
+    INIT_LIST_HEAD(&d->d_sb_list);
+    return d;
+}
+
+static void d_free(struct dentry *d)
+{
+    iput(d->d_inode);
+    kfree(d->d_name);
+    kmem_cache_free(&dentry_cache, d);
+}
+
+///@}
+
+/** @name Hash table */
+///@{
+
+/** FNV-1a hash of a name, seeded with its parent's address */
+static uint32_t d_hashname(struct dentry *parent, const char *name, size_t len)
+{
+    uint32_t h = 2166136261u ^ (uint32_t) (uintptr_t) parent;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char) name[i]) * 16777619u;
+    return h;
+}
+
+static struct list_head *d_bucket(uint32_t hashval)
+{
+    struct list_head *b = &dcache_hash[hashval & (DCACHE_BUCKETS - 1)];
+    if (!b->next) INIT_LIST_HEAD(b); // First use.
+    return b;
+}
+
+/** Add a new non-root entry to the cache */
+static void d_add(struct dentry *d)
+{
+    list_add(&d->d_hash, d_bucket(d->d_hashval));
+    list_add(&d->d_lru, &dcache_lru);
+    list_add(&d->d_sb_list, &d->d_sb->s_dentries);
+    d->d_parent->d_nchildren++;
+    dcache_count++;
+}
+
+/** Remove a non-root entry from the cache and free it */
+static void d_drop(struct dentry *d)
+{
+    list_del(&d->d_hash);
+    list_del(&d->d_lru);
+    list_del(&d->d_sb_list);
+    d->d_parent->d_nchildren--;
+    dcache_count--;
+    d_free(d);
+}
+
+/**
+ * Evict least-recently-used entries until the cache is back to its limit
+ *
+ * Only unreferenced leaves are evicted. A child is keyed by its parent's
+ * address, so the parent must outlive it.
+ *
+ * @param   keep    Entry to keep regardless, i.e. the one just added
+ */
+static void dcache_shrink(struct dentry *keep)
+{
+    struct dentry *d, *tmp;
+    list_for_each_entry_safe_reverse(d, tmp, &dcache_lru, d_lru)
+    {
+        if (dcache_count <= DCACHE_MAX) return;
+        if (d != keep && !d->d_nchildren && !d->d_count) d_drop(d);
+    }
+}
+
+/** Find a cached entry */
+static struct dentry *d_lookup(
+        struct dentry *parent, const char *name, size_t len, uint32_t hashval
+)
+{
+    struct dentry *d;
+    list_for_each_entry(d, d_bucket(hashval), d_hash)
+    {
+        if (d->d_hashval == hashval && d->d_parent == parent
+            && d->d_namelen == len && memcmp(d->d_name, name, len) == 0)
+            return d;
+    }
+    return NULL;
+}
+
+///@}
+
+/** @name Dentry cache interface */
+///@{
+
+/**
+ * Set up a superblock's root entry
+ *
+ * Called before the driver's sb_open method, which should set the root
+ * entry's @ref dentry.d_inode.
+ */
+int dcache_init_sb(struct superblock *sb)
+{
+    INIT_LIST_HEAD(&sb->s_dentries);
+    sb->s_root = d_alloc(sb, NULL, "", 0, 0);
+    return sb->s_root ? 0 : -ENOMEM;
+}
+
+/**
+ * Drop a superblock's cached entries
+ *
+ * Entries that are still referenced (see dget()) are kept, along with their
+ * ancestors. Everything else goes, except the root.
+ */
+void dcache_invalidate_sb(struct superblock *sb)
+{
+    struct dentry *d, *tmp;
+    for (int dropped = 1; dropped;) {
+        dropped = 0;
+        list_for_each_entry_safe(d, tmp, &sb->s_dentries, d_sb_list)
+        {
+            if (d->d_nchildren || d->d_count) continue;
+            d_drop(d);
+            dropped = 1;
+        }
+    }
+}
+
+/** Drop all of a superblock's cached entries, and its root */
+void dcache_release_sb(struct superblock *sb)
+{
+    struct dentry *d, *tmp;
+    list_for_each_entry_safe(d, tmp, &sb->s_dentries, d_sb_list)
+    {
+        list_del(&d->d_hash);
+        list_del(&d->d_lru);
+        list_del(&d->d_sb_list);
+        dcache_count--;
+        d_free(d);
+    }
+    if (sb->s_root) d_free(sb->s_root);
+    sb->s_root = NULL;
+}
+
+/** Take a reference to an entry, so that it is not evicted */
+struct dentry *dget(struct dentry *d)
+{
+    if (d) d->d_count++;
+    return d;
+}
+
+/** Drop a reference to an entry */
+void dput(struct dentry *d)
+{
+    if (d) d->d_count--;
+}
+
+/**
+ * Look up one name in a directory, in the cache or else via the driver
+ *
+ * @returns 0 and sets *dp to the entry, or negative error code. The entry is
+ *          negative (@ref dentry.d_inode is NULL) if the name does not exist.
+ */
+int dcache_lookup(
+        struct dentry *dir, const char *name, size_t len, struct dentry **dp
+)
+{
+    int      res;
+    uint32_t hashval = d_hashname(dir, name, len);
+
+    /* Cache hit: mark as recently used. */
+    struct dentry *d = d_lookup(dir, name, len, hashval);
+    if (d) {
+        list_move(&d->d_lru, &dcache_lru);
+        *dp = d;
+        return 0;
+    }
+
+    /* Cache miss: ask the driver. */
+    const struct file_operations *f_op = dir->d_sb->s_op->fs_file_ops;
+    if (!f_op || !f_op->lookup) return -ENOTSUP;
+    d = d_alloc(dir->d_sb, dir, name, len, hashval);
+    if (!d) return -ENOMEM;
+    res = f_op->lookup(dir, d);
+    if (res < 0 && res != -ENOENT) {
+        d_free(d); // Not cached: the error may be temporary.
+        return res;
+    }
+    d_add(d);
+    dcache_shrink(d);
+    *dp = d;
+    return 0;
+}
+
+///@}
@@ -1,4 +1,4 @@
-#define LOG_LEVEL LOG_DEBUG
+// #define LOG_LEVEL LOG_DEBUG
 #include "vfs.h"
 
 #include <drivers/devices.h>
@@ -56,9 +56,12 @@ int file_open_dev(struct file *file, dev_t rdev)
 
 int file_close(struct file *file)
 {
-    if (file && file->f_op && file->f_op->release)
-        return file->f_op->release(file);
-    else return 0;
+    int res = 0;
+    if (!file) return 0;
+    if (file->f_op && file->f_op->release) res = file->f_op->release(file);
+    iput(file->f_inode);
+    file->f_inode = NULL;
+    return res;
 }
 
 int file_debugstr(char *descbuf, size_t n, struct file *f)
@@ -126,6 +129,44 @@ int file_ioctl(struct file *f, unsigned cmd, uintptr_t arg)
     return f->f_op->ioctl(f, cmd, arg);
 }
 
+/**
+ * Get the physical address of part of a file's contents.
+ *
+ * Works only for files whose contents already sit in memory, such as files
+ * on a ramdisk. The memory can then be used in place, e.g. mapped into a
+ * process, instead of being copied.
+ *
+ * @returns 0 and sets *paddr if [off, off + len) is physically contiguous
+ *          memory, or
+ *          - -ENOTSUP if the file is not backed by memory
+ *          - -EINVAL if the range is outside the file
+ */
+int file_phys_addr(struct file *f, loff_t off, size_t len, uintptr_t *paddr)
+{
+    if (!f || !f->f_op || !paddr) return -EINVAL;
+    if (!f->f_op->phys_addr) return -ENOTSUP;
+    return f->f_op->phys_addr(f, off, len, paddr);
+}
+
+/**
+ * Get a pointer to a file's contents, to use them in place.
+ *
+ * For files that sit in memory, such as ramdisks, this avoids copying data
+ * through a buffer. The memory is only valid as long as the file is open.
+ *
+ * @returns the number of bytes available at *kaddr (at most len, and 0 at
+ *          end of file), or
+ *          - -ENOTSUP if the file is not in memory
+ *          - other negative error code
+ */
+ssize_t
+file_direct_access(struct file *f, loff_t off, size_t len, void **kaddr)
+{
+    if (!f || !f->f_op || !kaddr) return -EINVAL;
+    if (!f->f_op->direct_access) return -ENOTSUP;
+    return f->f_op->direct_access(f, off, len, kaddr);
+}
+
 int file_readstr(struct file *f, char *dst, size_t n)
 {
     if (!n) return 0;
@@ -135,34 +176,22 @@ int file_readstr(struct file *f, char *dst, size_t n)
     return res;
 }
 
-#define DEFAULT_BUFSZ 256
+int file_fmt_sink(void *ctx, const char *buf, size_t n)
+{
+    struct file *f = ctx;
+    while (n) {
+        ssize_t res = file_write(f, buf, n);
+        if (res < 0) return res;
+        if (!res) return -EIO; // No progress: give up rather than spin.
+        buf += res, n -= res;
+    }
+    return 0;
+}
 
 int file_vprintf(struct file *f, const char *fmt, va_list va)
 {
-    /* To format into a file, we first format into a buffer, and then write
-     * from the buffer into the file. We don't know how big a buffer we need
-     * though, so we might have to do this twice: first with the default size,
-     * then with the correct size. */
-    va_list va_tmp;
-    int     bufsz = DEFAULT_BUFSZ;
-    for (;;) {
-        /* Allocate a temporary buffer and format into it. */
-        char buf[bufsz];     // Buffer for this iteration.
-        va_copy(va_tmp, va); // Copy of arg state for this iteration.
-        int len = vsnprintf(buf, bufsz, fmt, va_tmp);
-        va_end(va_tmp);
-
-        /* Check for errors. */
-        if (len < 0) return len;
-
-        /* If the formatting was complete, write the output to the file. */
-        if (len < bufsz) return file_write(f, buf, len);
-
-        /* If the buffer was too small, we now know exactly how long the
-         * formatted output is. Run through the loop again, this time
-         * with the correct buffer size. */
-        bufsz = len + 1;
-    }
+    /* Format straight into the file, a chunk at a time. */
+    return vcbprintf(file_fmt_sink, f, fmt, va);
 }
 
 ATTR_PRINTFLIKE(2, 3)
@@ -8,9 +8,14 @@
 #include <core/errno.h>
 #include <core/macros.h>
 #include <core/path.h>
+#include <core/slab.h>
 #include <core/sprintf.h>
 #include <core/string.h>
 
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+
 /** @name VFS filesystem driver registration */
 ///@{
 
@@ -40,19 +45,14 @@ int fs_register(unsigned fstypeid, const struct fs_operations *ops)
 /** @name superblock operations */
 ///@{
 
-#define SB_MAX 4
-static struct superblock superblocks[SB_MAX];
+static KMEM_CACHE(sb_cache, "superblock", struct superblock, NULL);
 
 static struct superblock *sb_alloc(void)
 {
-    for (size_t i = 0; i < ARRAY_SIZE(superblocks); i++) {
-        struct superblock *sb = &superblocks[i];
-        if (!sb->s_op) return sb;
-    }
-    return NULL;
+    return kmem_cache_alloc(&sb_cache);
 }
 
-static void sb_free(struct superblock *sb) { sb->s_op = NULL; }
+static void sb_free(struct superblock *sb) { kmem_cache_free(&sb_cache, sb); }
 
 static int sb_open(struct superblock *sb, dev_t blockdev, unsigned fstypeid)
 {
@@ -67,12 +67,17 @@ static int sb_open(struct superblock *sb, dev_t blockdev, unsigned fstypeid)
             .s_bdev = blockdev,
             .s_op   = s_op,
     };
-    INIT_LIST_HEAD(&sb->s_mount_list);
+    /* Set up root dentry, for the driver to fill in. */
+    res = dcache_init_sb(sb);
+    if (res < 0) return res;
 
     /* Call driver's open method. */
     if (sb->s_op->sb_open) {
         res = sb->s_op->sb_open(sb);
-        if (res < 0) return res;
+        if (res < 0) {
+            dcache_release_sb(sb);
+            return res;
+        }
     }
 
     return 0;
@@ -80,6 +85,10 @@ static int sb_open(struct superblock *sb, dev_t blockdev, unsigned fstypeid)
 
 static int sb_release(struct superblock *sb)
 {
+    /* Cached entries and inodes point into the driver's data, so drop them
+     * before the driver frees it. */
+    dcache_release_sb(sb);
+
     /* Call driver method. */
     if (sb->s_op->sb_release) return sb->s_op->sb_release(sb);
     else return 0;
@@ -90,17 +99,119 @@ static int sb_release(struct superblock *sb)
 /** @name FS mounting and lookup */
 ///@{
 
-struct list_head vfs_mount_list = LIST_HEAD_INIT(vfs_mount_list);
+/**
+ * Node in the mount trie
+ *
+ * There is a node for each path component on the way to a mount point, so
+ * finding the mount for a path takes one step per component, no matter how
+ * many filesystems are mounted. Matching whole components also means that
+ * "/mntx" is not mistaken for a path under "/mnt".
+ */
+struct mount_node {
+    struct mount_node *parent;   ///< Parent node (NULL for root)
+    struct list_head   sibling;  ///< Entry in parent's children, by name
+    struct list_head   children; ///< Child nodes
+    char              *name;     ///< Path component
+    size_t             namelen;  ///< Length of path component
+    struct superblock *sb;       ///< Filesystem mounted here, or NULL
+};
+
+static struct mount_node mount_root = {
+        .children = LIST_HEAD_INIT(mount_root.children),
+        .name     = "",
+};
+
+static struct mount_node *
+mount_child(struct mount_node *n, const char *name, size_t len)
+{
+    struct mount_node *child;
+    list_for_each_entry(child, &n->children, sibling)
+    {
+        if (child->namelen == len && memcmp(child->name, name, len) == 0)
+            return child;
+    }
+    return NULL;
+}
+
+/** Add a child node, keeping children sorted by name */
+static struct mount_node *
+mount_child_add(struct mount_node *n, const char *name, size_t len)
+{
+    struct mount_node *child = kzalloc(sizeof(*child));
+    if (!child) return NULL;
+    child->name = kmalloc(len + 1);
+    if (!child->name) {
+        kfree(child);
+        return NULL;
+    }
+    memcpy(child->name, name, len);
+    child->name[len] = '\0';
+    child->namelen   = len;
+    child->parent    = n;
+    INIT_LIST_HEAD(&child->children);
+
+    struct mount_node *pos;
+    list_for_each_entry(pos, &n->children, sibling)
+    {
+        if (strcmp(pos->name, child->name) > 0) break;
+    }
+    list_add_tail(&child->sibling, &pos->sibling);
+    return child;
+}
+
+static int mount_insert(struct superblock *sb, const char *mpath)
+{
+    struct mount_node *n = &mount_root;
+    const char        *comp;
+    for (size_t len; (len = path_next(&mpath, &comp));) {
+        if (len == 1 && comp[0] == '.') continue;
+        struct mount_node *child = mount_child(n, comp, len);
+        if (!child) child = mount_child_add(n, comp, len);
+        if (!child) return -ENOMEM;
+        n = child;
+    }
+    if (n->sb) return -EBUSY;
+    n->sb = sb;
+    return 0;
+}
 
-static void vfs_mount_list_add(struct superblock *sb)
+/** Find the mount trie node for a path, without adding any */
+static struct mount_node *mount_find(const char *mpath)
 {
-    struct superblock *pos;
-    list_for_each_entry(pos, &vfs_mount_list, s_mount_list)
+    struct mount_node *n = &mount_root;
+    const char        *comp;
+    for (size_t len; n && (len = path_next(&mpath, &comp));) {
+        if (len == 1 && comp[0] == '.') continue;
+        n = mount_child(n, comp, len);
+    }
+    return n;
+}
+
+static int
+mount_foreach_node(struct mount_node *n, vfs_mount_fn *fn, void *ctx)
+{
+    int res;
+    if (n->sb) {
+        res = fn(n->sb, ctx);
+        if (res < 0) return res;
+    }
+    struct mount_node *child;
+    list_for_each_entry(child, &n->children, sibling)
     {
-        /* Keep list sorted by mount path. */
-        if (strcmp(pos->s_mountpath, sb->s_mountpath) > 0) break;
+        res = mount_foreach_node(child, fn, ctx);
+        if (res < 0) return res;
     }
-    list_add_tail(&sb->s_mount_list, &vfs_mount_list);
+    return 0;
+}
+
+/**
+ * Call a function for each mounted filesystem, sorted by mount path
+ *
+ * Stops early if the function returns a negative error code.
+ */
+int vfs_mount_foreach(vfs_mount_fn *fn, void *ctx)
+{
+    return mount_foreach_node(&mount_root, fn, ctx);
 }
 
 int fs_mountdev(dev_t blockdev, unsigned fstypeid, const char *mpath)
@@ -122,8 +233,9 @@ int fs_mountdev(dev_t blockdev, unsigned fstypeid, const char *mpath)
     /* Copy mount path. */
     snprintf(sb->s_mountpath, sizeof(sb->s_mountpath), "%s", mpath);
 
-    /* Add to mount list. */
-    vfs_mount_list_add(sb);
+    /* Add to mount trie. */
+    res = mount_insert(sb, mpath);
+    if (res < 0) goto exit;
 
     res = 0;
 exit:
@@ -135,74 +247,330 @@ exit:
     return res;
 }
 
-static struct superblock *find_mount_for_path(const char *abspath)
+/**
+ * Check whether anything but the superblock's own root entry uses it
+ *
+ * Path handles hold entries (see dget()), and open files hold inodes.
+ */
+static bool sb_busy(struct superblock *sb)
 {
-    struct superblock *sb;
-    list_for_each_entry_prev(sb, &vfs_mount_list, s_mount_list)
-    {
-        if (strstr(abspath, sb->s_mountpath) == abspath) return sb;
+    struct inode *root = sb->s_root->d_inode;
+    if (sb->s_root->d_count || !list_empty(&sb->s_dentries)) return true;
+    return sb->s_ninodes > (root ? 1u : 0u) || (root && root->i_count > 1);
+}
+
+/**
+ * Unmount the filesystem mounted at a path
+ *
+ * Cached entries that nobody holds are dropped first, so only real users make
+ * the filesystem busy. The mount trie keeps its nodes, since path handles
+ * elsewhere may point at them.
+ *
+ * @returns 0 on success, or
+ *          - -EINVAL if nothing is mounted at @a mpath
+ *          - -EBUSY if files or path handles on the filesystem are still open
+ */
+int fs_umount(const char *mpath)
+{
+    struct mount_node *n   = mount_find(mpath);
+    struct superblock *sb  = n ? n->sb : NULL;
+    int                res = sb ? 0 : -EINVAL;
+    if (res < 0) goto exit;
+
+    dcache_invalidate_sb(sb);
+    res = sb_busy(sb) ? -EBUSY : 0;
+    if (res < 0) goto exit;
+
+    n->sb = NULL;
+    res   = sb_release(sb);
+    sb_free(sb);
+exit:
+    log_result(res, "unmount %s\n", mpath);
+    return res;
+}
+
+///@}
+
+/** @name Path resolution */
+///@{
+
+/** Set a path handle to the root of the namespace */
+static void namei_root(struct vfs_path *nd)
+{
+    *nd = (struct vfs_path){
+            .sb     = mount_root.sb,
+            .dentry = mount_root.sb ? mount_root.sb->s_root : NULL,
+            .mnode  = &mount_root,
+    };
+}
+
+/**
+ * Step down into one path component
+ *
+ * Mount points are checked first, since a mount hides whatever is under it.
+ * A mount trie node that has no directory under it in the filesystem above
+ * (e.g. "/a" when only "/a/b" is mounted) is a valid place to walk through,
+ * with no dentry, but not a file that can be opened.
+ */
+static int namei_step(struct vfs_path *nd, const char *name, size_t len)
+{
+    int            res;
+    struct dentry *d = NULL;
+
+    if (nd->dentry && nd->dentry->d_inode->i_stat.f_type != DT_DIR)
+        return -ENOTDIR;
+
+    /* Follow the mount trie while we are on it. */
+    if (!nd->mdepth) {
+        struct mount_node *child = mount_child(nd->mnode, name, len);
+        if (child && child->sb) {
+            nd->sb     = child->sb;
+            nd->dentry = child->sb->s_root;
+            nd->mnode  = child;
+            return 0;
+        }
+        if (child) {
+            if (nd->dentry) {
+                res = dcache_lookup(nd->dentry, name, len, &d);
+                if (res < 0 && res != -ENOENT) return res;
+                if (res < 0 || !d->d_inode) d = NULL;
+            }
+            nd->dentry = d;
+            nd->mnode  = child;
+            return 0;
+        }
     }
-    return NULL;
+
+    /* Look up in the filesystem. */
+    if (!nd->dentry) return -ENOENT;
+    res = dcache_lookup(nd->dentry, name, len, &d);
+    if (res < 0) return res;
+    if (!d->d_inode) return -ENOENT;
+    nd->dentry = d;
+    nd->mdepth++;
+    return 0;
+}
+
+/** Walk from the namespace root to a mount trie node */
+static int namei_mnode(struct vfs_path *nd, struct mount_node *mn)
+{
+    if (!mn->parent) {
+        namei_root(nd);
+        return 0;
+    }
+    int res = namei_mnode(nd, mn->parent);
+    if (res < 0) return res;
+    return namei_step(nd, mn->name, mn->namelen);
+}
+
+/**
+ * Step up to the parent directory
+ *
+ * Within a filesystem this is just the parent dentry. At a mount trie node
+ * (e.g. the root of a mounted filesystem), the parent is found again from the
+ * namespace root, which is a short walk of cached entries.
+ */
+static int namei_up(struct vfs_path *nd)
+{
+    if (nd->mdepth) {
+        nd->dentry = nd->dentry->d_parent;
+        nd->mdepth--;
+        return 0;
+    }
+    if (!nd->mnode->parent) return 0; // "/.." is "/".
+    return namei_mnode(nd, nd->mnode->parent);
+}
+
+/**
+ * Resolve a path, component by component, from a position
+ *
+ * Absolute paths start over from the root. Empty and "." components are
+ * skipped, and ".." goes up. The path is never copied, so there is no limit
+ * on its length.
+ *
+ * @param   nd      Starting position, updated in place. No references are
+ *                  taken: the caller must use the result right away, or
+ *                  take its own with vfs_path_get().
+ * @param   path    Path to resolve (NULL is the same as "")
+ */
+static int namei(struct vfs_path *nd, const char *path)
+{
+    int         res;
+    const char *comp;
+    if (!path) return 0;
+    if (path[0] == '/') namei_root(nd);
+    for (size_t len; (len = path_next(&path, &comp));) {
+        if (len == 1 && comp[0] == '.') continue;
+        if (len == 2 && comp[0] == '.' && comp[1] == '.') res = namei_up(nd);
+        else res = namei_step(nd, comp, len);
+        if (res < 0) return res;
+    }
+    return 0;
+}
+
+/** Resolve a path from a string starting directory */
+static int namei_cwd(struct vfs_path *nd, const char *cwd, const char *path)
+{
+    namei_root(nd);
+    int res = path && path[0] == '/' ? 0 : namei(nd, cwd);
+    if (res < 0) return res;
+    res = namei(nd, path);
+    if (res < 0) return res;
+    return nd->dentry ? 0 : -ENOENT;
+}
+
+/** Take references to keep a path handle valid */
+void vfs_path_get(struct vfs_path *p) { dget(p->dentry); }
+
+/** Drop a path handle's references */
+void vfs_path_put(struct vfs_path *p)
+{
+    dput(p->dentry);
+    p->dentry = NULL;
 }
 
-static int file_open_sb_path(
-        struct file *file, struct superblock *sb, const char *relpath
+/** Get a handle to the root directory */
+void vfs_path_root(struct vfs_path *p)
+{
+    namei_root(p);
+    vfs_path_get(p);
+}
+
+/**
+ * Resolve a path to a handle, e.g. for a working directory
+ *
+ * @param   res     New handle, to be released with vfs_path_put()
+ * @param   start   Directory that relative paths start from (NULL for root)
+ * @param   path    Path to resolve
+ */
+int vfs_path_lookup(
+        struct vfs_path *res, const struct vfs_path *start, const char *path
 )
 {
-    int res;
+    struct vfs_path nd;
+    if (start) nd = *start;
+    else namei_root(&nd);
+    int err = namei(&nd, path);
+    if (err < 0) return err;
+    if (!nd.dentry) return -ENOENT;
+    vfs_path_get(&nd);
+    *res = nd;
+    return 0;
+}
 
-    /* Check inputs. */
-    res = file && sb && sb->s_op ? 0 : -EINVAL;
-    if (res < 0) goto exit;
+/**
+ * Get the absolute path of a handle, normalized
+ *
+ * The name is built from the end, walking up, so there is no limit on the
+ * depth of the directory tree.
+ *
+ * @returns length of path, like snprintf(). If it does not fit, buf is set
+ *          to an empty string.
+ */
+int vfs_path_name(char *buf, size_t n, const struct vfs_path *p)
+{
+    struct dentry     *d;
+    struct mount_node *mn;
+    size_t             len = 0;
+    unsigned           i;
+
+    /* Measure. */
+    for (d = p->dentry, i = 0; i < p->mdepth; d = d->d_parent, i++)
+        len += 1 + d->d_namelen;
+    for (mn = p->mnode; mn->parent; mn = mn->parent) len += 1 + mn->namelen;
+    if (!len) return snprintf(buf, n, "/");
+    if (len >= n) {
+        if (n) buf[0] = '\0';
+        return len;
+    }
+
+    /* Fill in, from the end. */
+    char *pos = buf + len;
+    *pos      = '\0';
+    for (d = p->dentry, i = 0; i < p->mdepth; d = d->d_parent, i++) {
+        pos -= d->d_namelen;
+        memcpy(pos, d->d_name, d->d_namelen);
+        *--pos = '/';
+    }
+    for (mn = p->mnode; mn->parent; mn = mn->parent) {
+        pos -= mn->namelen;
+        memcpy(pos, mn->name, mn->namelen);
+        *--pos = '/';
+    }
+    return len;
+}
+
+///@}
+
+/** @name File access by path */
+///@{
+
+static int file_open_dentry(struct file *file, struct dentry *d)
+{
+    int res;
 
     /* Check if superblock supports operation. */
-    const struct file_operations *f_op = sb->s_op->fs_file_ops;
-    res = f_op && f_op->open_path ? 0 : -ENOTSUP;
-    if (res < 0) goto exit;
+    const struct file_operations *f_op = d->d_sb->s_op->fs_file_ops;
+    if (!f_op || !f_op->open_dentry) return -ENOTSUP;
 
-    /* Reset struct. */
+    /* Reset struct, sharing the dentry's inode. */
     *file = (struct file){
-            .f_op = sb->s_op->fs_file_ops,
+            .f_stat  = d->d_inode->i_stat,
+            .f_inode = igrab(d->d_inode),
+            .f_op    = f_op,
     };
 
     /* Call driver method. */
-    if (file->f_op->open_path) {
-        res = file->f_op->open_path(file, sb, relpath);
-        if (res < 0) goto exit;
+    res = file->f_op->open_dentry(file, d);
+    debug_result(res, "open via dentry: %s:%s\n", d->d_sb->s_name, d->d_name);
+    if (res < 0) {
+        iput(file->f_inode);
+        file->f_inode = NULL;
     }
-
-    res = 0;
-exit:
-    debug_result(res, "open via superblock: %s:%s\n", sb->s_name, relpath);
     return res;
 }
 
-static int file_open_path_abs(struct file *file, const char *abspath)
+int file_open_path(struct file *file, const char *cwd, const char *path)
 {
-    struct superblock *sb = find_mount_for_path(abspath);
-    if (!sb) return -ENOENT;
-    if (!sb->s_op->fs_file_ops->open_path) return -ENOTSUP;
+    struct vfs_path nd;
+    int             res = namei_cwd(&nd, cwd, path);
+    if (res < 0) return res;
+    return file_open_dentry(file, nd.dentry);
+}
 
-    const char *relpath = path_strip_prefix(abspath, sb->s_mountpath);
-    return file_open_sb_path(file, sb, relpath);
+int file_stat(struct fstat *fstat, const char *cwd, const char *path)
+{
+    /* With cached entries, the driver is not involved at all. */
+    struct vfs_path nd;
+    int             res = namei_cwd(&nd, cwd, path);
+    if (res < 0) return res;
+    *fstat = nd.dentry->d_inode->i_stat;
+    return 0;
 }
 
-int file_open_path(struct file *file, const char *cwd, const char *path)
+/** Open a file, with relative paths starting from a directory handle */
+int file_openat(
+        struct file *file, const struct vfs_path *dir, const char *path
+)
 {
-    int  n = PATH_MAX;
-    char absbuf[n];
-    path_join(absbuf, n, cwd, path);
-    return file_open_path_abs(file, absbuf);
+    struct vfs_path nd = *dir;
+    int             res = namei(&nd, path);
+    if (res < 0) return res;
+    if (!nd.dentry) return -ENOENT;
+    return file_open_dentry(file, nd.dentry);
 }
 
-int file_stat(struct fstat *fstat, const char *cwd, const char *path)
+/** Get file metadata, with relative paths starting from a directory handle */
+int file_statat(
+        struct fstat *fstat, const struct vfs_path *dir, const char *path
+)
 {
-    struct file f;
-    int         res = file_open_path(&f, cwd, path);
+    struct vfs_path nd = *dir;
+    int             res = namei(&nd, path);
     if (res < 0) return res;
-    *fstat = f.f_stat;
-    file_close(&f);
-    return res;
+    if (!nd.dentry) return -ENOENT;
+    *fstat = nd.dentry->d_inode->i_stat;
+    return 0;
 }
 
 int file_readdir(struct file *f, struct dirent *d)
@@ -213,4 +581,53 @@ int file_readdir(struct file *f, struct dirent *d)
     return f->f_op->readdir(f, d);
 }
 
+/**
+ * Read many directory entries at once
+ *
+ * Fills buf with packed @ref dirent_rec records, in one call to the driver.
+ * Each record's @ref dirent_rec.d_off is a cookie: seeking the directory to
+ * it with file_lseek() resumes the listing after that entry.
+ *
+ * @returns number of bytes filled, 0 at end of directory, -EINVAL if buf is
+ *          too small for the next entry, or other negative error code
+ */
+ssize_t file_getdents(struct file *f, void *buf, size_t len)
+{
+    if (!f || !f->f_op || !f->f_op->getdents) return -EINVAL;
+    if (!buf) return -EINVAL;
+    if (f->f_stat.f_type != DT_DIR) return -ENOTDIR;
+    return f->f_op->getdents(f, buf, len);
+}
+
+/**
+ * Append a record to a file_getdents() buffer (for drivers)
+ *
+ * @returns size of the record, or 0 if it does not fit in len bytes
+ */
+size_t dirent_rec_pack(
+        void          *buf,
+        size_t         len,
+        ino_t          ino,
+        loff_t         off,
+        unsigned char  type,
+        const char    *name,
+        size_t         namelen
+)
+{
+    size_t reclen = ALIGN_UP(
+            offsetof(struct dirent_rec, d_name) + namelen + 1,
+            alignof(struct dirent_rec)
+    );
+    if (reclen > len || (unsigned short) reclen != reclen) return 0;
+
+    struct dirent_rec *rec = buf;
+    rec->d_ino             = ino;
+    rec->d_off             = off;
+    rec->d_reclen          = reclen;
+    rec->d_type            = type;
+    memcpy(rec->d_name, name, namelen);
+    rec->d_name[namelen] = '\0';
+    return reclen;
+}
+
 ///@}
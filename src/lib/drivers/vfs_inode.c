@@ -0,0 +1,74 @@
+// #define LOG_LEVEL LOG_DEBUG
+
+#include "vfs.h"
+
+#include <drivers/log.h>
+
+#include <core/list.h>
+#include <core/slab.h>
+
+#define INODE_BUCKETS 256 ///< Number of hash buckets (power of two)
+
+static KMEM_CACHE(inode_cache, "inode", struct inode, NULL);
+
+static struct list_head inode_hash[INODE_BUCKETS];
+
+static struct list_head *i_bucket(struct superblock *sb, ino_t ino)
+{
+    uint32_t h = ((uint32_t) (uintptr_t) sb ^ ino) * 2654435761u; // Knuth
+    struct list_head *b = &inode_hash[h >> 24 & (INODE_BUCKETS - 1)];
+    if (!b->next) INIT_LIST_HEAD(b); // First use.
+    return b;
+}
+
+/**
+ * Get the in-core inode for (sb, ino), creating it if needed
+ *
+ * All users of the same file share one inode. A new inode has @ref I_NEW set
+ * in @ref inode.i_state, and only its key filled in. The caller (normally the
+ * filesystem driver) should fill in the rest and then clear @ref I_NEW.
+ *
+ * @returns a new reference to the inode, to be dropped with iput(), or NULL
+ *          if out of memory
+ */
+struct inode *iget(struct superblock *sb, ino_t ino)
+{
+    struct list_head *bucket = i_bucket(sb, ino);
+    struct inode     *inode;
+    list_for_each_entry(inode, bucket, i_hash)
+    {
+        if (inode->i_sb == sb && inode->i_ino == ino) return igrab(inode);
+    }
+
+    inode = kmem_cache_alloc(&inode_cache);
+    if (!inode) return NULL;
+    *inode = (struct inode){
+            .i_sb    = sb,
+            .i_ino   = ino,
+            .i_stat  = {.f_ino = ino},
+            .i_state = I_NEW,
+            .i_count = 1,
+    };
+    list_add(&inode->i_hash, bucket);
+    sb->s_ninodes++;
+    pr_debug("new inode %s:%u\n", sb->s_name, (unsigned) ino);
+    return inode;
+}
+
+/** Take another reference to an inode */
+struct inode *igrab(struct inode *inode)
+{
+    if (inode) inode->i_count++;
+    return inode;
+}
+
+/** Drop a reference to an inode, and free it if it was the last one */
+void iput(struct inode *inode)
+{
+    if (!inode || --inode->i_count) return;
+    list_del(&inode->i_hash);
+    inode->i_sb->s_ninodes--;
+    const struct fs_operations *s_op = inode->i_sb->s_op;
+    if (s_op->evict_inode) s_op->evict_inode(inode);
+    kmem_cache_free(&inode_cache, inode);
+}
@@ -0,0 +1,221 @@
+/**
+ * @file
+ * Build tool: add a path index to a CPIO "newc" archive
+ *
+ * Reads an archive on stdin and writes it to stdout with an index member in
+ * front, and with filler members so that the data of every regular file is
+ * page-aligned. See drivers/fileformat/cpio_index.h for the index format.
+ *
+ * This is a hosted program that runs on the build machine, not in the kernel.
+ */
+#include <drivers/fileformat/cpio_index.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NEWC_HSIZE 110 ///< Size of a "newc" header
+#define TRAILER    "TRAILER!!!"
+
+#define ALIGN4(X) (((X) + 3) & ~(size_t) 3)
+
+/** Size of a filler member's header and path */
+#define PAD_HSIZE ALIGN4(NEWC_HSIZE + sizeof(CPIO_PAD_NAME))
+
+struct member {
+    const char *path;
+    uint32_t    hoff, ino, mode, fsize, devmajor, devminor;
+    uint32_t    inoff;  ///< Header offset in the input archive
+    uint32_t    len;    ///< Size of header, path and data, padded
+    uint32_t    pad;    ///< Data size of filler member in front
+    int         haspad; ///< Member has a filler in front
+};
+
+static const char *progname = "cpio-index";
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "%s: %s\n", progname, msg);
+    exit(1);
+}
+
+static void *xrealloc(void *p, size_t size)
+{
+    p = realloc(p, size);
+    if (!p) die("out of memory");
+    return p;
+}
+
+/** Read all of stdin */
+static char *read_all(size_t *size)
+{
+    size_t cap = 1 << 16, n = 0, got;
+    char  *buf = xrealloc(NULL, cap);
+    while ((got = fread(buf + n, 1, cap - n, stdin)) > 0) {
+        n += got;
+        if (n == cap) buf = xrealloc(buf, cap *= 2);
+    }
+    if (ferror(stdin)) die("read error");
+    *size = n;
+    return buf;
+}
+
+/** Decode an 8-digit hex header field */
+static uint32_t field(const char *h, unsigned i)
+{
+    char digits[9];
+    memcpy(digits, h + 6 + 8 * i, 8);
+    digits[8] = '\0';
+
+    char         *end;
+    unsigned long val = strtoul(digits, &end, 16);
+    if (*end) die("bad hex digit in header");
+    return val;
+}
+
+static void put32(uint32_t val, FILE *out)
+{
+    unsigned char b[4] = {val, val >> 8, val >> 16, val >> 24};
+    fwrite(b, 1, 4, out);
+}
+
+static void put_zeroes(size_t n, FILE *out)
+{
+    while (n--) putc(0, out);
+}
+
+static void put_hdr(const char *path, uint32_t mode, size_t fsize, FILE *out)
+{
+    size_t namesz = strlen(path) + 1;
+    fprintf(out, "070701%08X%08X%08X%08X%08X%08X%08zX%08X%08X%08X%08X%08zX%08X",
+            0, mode, 0, 0, 1, 0, fsize, 0, 0, 0, 0, namesz, 0);
+    fwrite(path, 1, namesz, out);
+    put_zeroes(ALIGN4(NEWC_HSIZE + namesz) - (NEWC_HSIZE + namesz), out);
+}
+
+/**
+ * Work out the filler needed in front of a member at offset @a off
+ *
+ * The filler is a member of its own, so it can only push the data on by its
+ * header size or more. Its data makes up the rest.
+ */
+static void place_member(struct member *m, size_t off)
+{
+    size_t dataoff = m->len - ALIGN4(m->fsize);
+
+    m->haspad = (m->mode & 0170000) == 0100000 && m->fsize
+                && (off + dataoff) % CPIO_PAD_ALIGN;
+    if (!m->haspad) return;
+    m->pad = -(off + PAD_HSIZE + dataoff) % CPIO_PAD_ALIGN;
+}
+
+static int cmp_member(const void *a, const void *b)
+{
+    return strcmp(((const struct member *) a)->path,
+                  ((const struct member *) b)->path);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 0) progname = argv[0];
+    if (argc > 1) {
+        fprintf(stderr, "usage: %s < archive.cpio > indexed.cpio\n", progname);
+        return 1;
+    }
+
+    size_t size;
+    char  *ar = read_all(&size);
+
+    /* Walk the archive and collect its members. */
+    struct member *m = NULL;
+    size_t         count = 0, strsize = 0, off = 0;
+    for (;;) {
+        if (off + NEWC_HSIZE > size) die("unexpected end of archive");
+        const char *h = ar + off;
+        if (memcmp(h, "070701", 6) != 0) die("not a newc archive");
+
+        uint32_t mode = field(h, 1), fsize = field(h, 6), psize = field(h, 11);
+        if (!psize || off + NEWC_HSIZE + psize > size)
+            die("bad path size in header");
+        const char *path = h + NEWC_HSIZE;
+        if (path[psize - 1]) die("path is not null-terminated");
+        if (strcmp(path, CPIO_INDEX_NAME) == 0) die("archive already indexed");
+        if (strcmp(path, TRAILER) == 0) break;
+
+        size_t next = ALIGN4(ALIGN4(off + NEWC_HSIZE + psize) + fsize);
+        if (next > size) die("unexpected end of archive");
+        if (strcmp(path, CPIO_PAD_NAME) == 0) {
+            off = next;
+            continue;
+        }
+
+        m        = xrealloc(m, (count + 1) * sizeof(*m));
+        m[count] = (struct member){
+                path, off, count + 1, mode, fsize, field(h, 7), field(h, 8),
+                .inoff = off, .len = next - off,
+        };
+        count++;
+        strsize += psize;
+        off = next;
+    }
+    size_t trailer = off;
+
+    /* Work out index size. */
+    size_t strtab  = sizeof(struct cpio_index_hdr)
+                     + count * sizeof(struct cpio_index_ent);
+    size_t datasz  = strtab + strsize;
+    size_t memberz = ALIGN4(ALIGN4(NEWC_HSIZE + sizeof(CPIO_INDEX_NAME))
+                            + datasz);
+
+    /* Lay out the other members after the index, with fillers. */
+    off = memberz;
+    for (size_t i = 0; i < count; i++) {
+        place_member(&m[i], off);
+        if (m[i].haspad) off += PAD_HSIZE + m[i].pad;
+        m[i].hoff  = off;
+        off       += m[i].len;
+    }
+
+    /* Sort a copy for the index, and keep archive order for the output. */
+    struct member *sorted = xrealloc(NULL, count * sizeof(*m));
+    memcpy(sorted, m, count * sizeof(*m));
+    qsort(sorted, count, sizeof(*m), cmp_member);
+
+    /* Index member header and path. */
+    FILE *out = stdout;
+    put_hdr(CPIO_INDEX_NAME, 0100444, datasz, out);
+
+    /* Index data: header, entries, string table. */
+    fwrite(CPIO_INDEX_MAGIC, 1, CPIO_INDEX_MAGICSZ, out);
+    put32(count, out);
+    put32(strtab, out);
+    put32(strsize, out);
+    put32(0, out);
+    for (size_t i = 0, stroff = 0; i < count; i++) {
+        put32(stroff, out);
+        put32(sorted[i].hoff, out);
+        put32(sorted[i].ino, out);
+        put32(sorted[i].mode, out);
+        put32(sorted[i].fsize, out);
+        put32(sorted[i].devmajor, out);
+        put32(sorted[i].devminor, out);
+        stroff += strlen(sorted[i].path) + 1;
+    }
+    for (size_t i = 0; i < count; i++)
+        fwrite(sorted[i].path, 1, strlen(sorted[i].path) + 1, out);
+    put_zeroes(ALIGN4(datasz) - datasz, out);
+
+    /* The original members, each behind its filler if it has one, and the
+     * trailer. */
+    for (size_t i = 0; i < count; i++) {
+        if (m[i].haspad) {
+            put_hdr(CPIO_PAD_NAME, 0100444, m[i].pad, out);
+            put_zeroes(m[i].pad, out);
+        }
+        fwrite(ar + m[i].inoff, 1, m[i].len, out);
+    }
+    fwrite(ar + trailer, 1, size - trailer, out);
+    if (fflush(out) || ferror(out)) die("write error");
+    return 0;
+}